@@ -27,72 +27,33 @@ label = data[2,0:3].astype(str)
 
 
 
-VG1 = data[3:503, 0].astype(float)
-VD1 = data[3:503, 1].astype(float)
-ID1 = data[3:503, 2].astype(float)
-
-VD1 = np.convolve(VD1,np.ones((filt,))/filt)
-ID1 = np.convolve(ID1,np.ones((filt,))/filt)
-
-VG2 = data[503:1003, 0].astype(float)
-VD2 = data[503:1003, 1].astype(float)
-ID2 = data[503:1003, 2].astype(float)
-
-VD2 = np.convolve(VD2,np.ones((filt,))/filt)
-ID2 = np.convolve(ID2,np.ones((filt,))/filt)
-
-VG3 = data[1003:1503, 0].astype(float)
-VD3 = data[1003:1503, 1].astype(float)
-ID3 = data[1003:1503, 2].astype(float)
-
-VD3 = np.convolve(VD3,np.ones((filt,))/filt)
-ID3 = np.convolve(ID3,np.ones((filt,))/filt)
-
-VG4 = data[1503:2003, 0].astype(float)
-VD4 = data[1503:2003, 1].astype(float)
-ID4 = data[1503:2003, 2].astype(float)
-
-VD4 = np.convolve(VD4,np.ones((filt,))/filt)
-ID4 = np.convolve(ID4,np.ones((filt,))/filt)
-
-VG5 = data[2003:2503, 0].astype(float)
-VD5 = data[2003:2503, 1].astype(float)
-ID5 = data[2003:2503, 2].astype(float)
-
-VD5 = np.convolve(VD5,np.ones((filt,))/filt)
-ID5 = np.convolve(ID5,np.ones((filt,))/filt)
-
-VG6 = data[2503:3003, 0].astype(float)
-VD6 = data[2503:3003, 1].astype(float)
-ID6 = data[2503:3003, 2].astype(float)
-
-VD6 = np.convolve(VD6,np.ones((filt,))/filt)
-ID6 = np.convolve(ID6,np.ones((filt,))/filt)
+# one curve per run of equal gate/base values (the tracer keeps the steps of a sweep distinct), any number of
+# curves and points
+VG = data[3:, 0].astype(float)
+VD = data[3:, 1].astype(float)
+ID = data[3:, 2].astype(float)
+starts = [0] + [i for i in range(1, len(VG)) if VG[i] != VG[i-1]] + [len(VG)]
+
+plots = []
+labels = []
+for c in range(len(starts) - 1):
+    n = starts[c+1] - starts[c]
+    f = max(1, min(filt, n // 50))     # 7 point filter and first 10 points dropped at 500 points
+    vd = np.convolve(VD[starts[c]:starts[c+1]], np.ones((f,))/f)
+    idd = np.convolve(ID[starts[c]:starts[c+1]], np.ones((f,))/f)
+    p, = plt.plot(vd[n // 50:n], idd[n // 50:n], linewidth=3.0)
+    plots.insert(0, p)
+    labels.insert(0, "%s = %.1f" % (label[0], VG[starts[c]]))
 
 #identify = data[0, 0:3].astype(str);
 
-p1, = plt.plot(VD1[10:500],ID1[10:500], linewidth=3.0)
-p2, = plt.plot(VD2[10:500],ID2[10:500], linewidth=3.0)
-p3, = plt.plot(VD3[10:500],ID3[10:500], linewidth=3.0)
-p4, = plt.plot(VD4[10:500],ID4[10:500], linewidth=3.0)
-p5, = plt.plot(VD5[10:500],ID5[10:500], linewidth=3.0)
-p6, = plt.plot(VD6[10:500],ID6[10:500], linewidth=3.0)
-
 plt.title('Curve Trace')
 plt.suptitle(tps[0]+' '+tps[1]+' '+identify[0]+' '+identify[1]+' '+identify[2]);
 plt.ylabel(label[2])
 plt.xlabel(label[1])
 plt.grid(True)
 
-p6lab = "%s = %.1f" % (label[0], VG6[0])
-p5lab = "%s = %.1f" % (label[0], VG5[0])
-p4lab = "%s = %.1f" % (label[0], VG4[0])
-p3lab = "%s = %.1f" % (label[0], VG3[0])
-p2lab = "%s = %.1f" % (label[0], VG2[0])
-p1lab = "%s = %.1f" % (label[0], VG1[0])
-
-
-legend = plt.legend([p6, p5, p4, p3, p2, p1], [p6lab, p5lab, p4lab, p3lab, p2lab, p1lab], loc='upper right', shadow=True)
+legend = plt.legend(plots, labels, loc='upper right', shadow=True)
 
 axes = plt.gca()
 axes.set_xlim([0,4.85])
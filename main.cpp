@@ -4,11 +4,34 @@
 #include <algorithm>
 #include <iostream>
 #include <unistd.h>
+#include <math.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <atomic>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include "trace.h"
+#include "plot.h"
 
 // Pi specific libraries
+#ifndef AD5592_SIM
 #include "bcm2835.h"
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
+#include <linux/gpio.h>
+#endif
 
 using namespace std;
 
@@ -21,6 +44,28 @@ using namespace std;
 #define ADCSEQUENCE 0b0001001001110000  // 0x1270
 #define RESET       0b0111110110101100  // 0x7DAC
 #define WORD_SIZE		2
+#define NOOP        0b0000000000000000  // 0x0000
+
+// Largest single SPI batch (DAC writes + sequence + read slots)
+#define BATCH_MAX_WORDS 512
+
+// Samples per ADC channel for each measurement
+#define ID_CELL_SAMPLES 16  // each terminal in each identification state
+#define ID_MAX_ROUNDS   29  // gate test captures before volt_cycle falls back to a plurality vote
+#define SPRT_ALPHA      0.001   // accepted gate/BJT decision error rate
+#define SPRT_EPS        0.05    // assumed chance one round votes for the wrong terminal
+#define SWEEP_SAMPLES 66    // each curve point
+
+// Adaptive averaging defaults
+#define AVG_SE_LSB      0.0     // standard error target in ADC LSBs, 0 = fixed sample counts
+#define AVG_MIN_SAMPLES 8       // per channel
+#define AVG_MAX_SAMPLES 200     // per channel
+
+// SPI backends, chosen at startup
+#define SPI_BCM2835 0
+#define SPI_SPIDEV  1
+#define SPIDEV_SPEED 3900000        // match the bcm2835 divider of 64
+#define SPIDEV_MAX_SEGMENTS 256     // frames per SPI_IOC_MESSAGE, keeps the ioctl size field in range
 
 // DAC write-out addresses
 #define DAC0_WRITE  0b1000000000000000
@@ -55,6 +100,10 @@ using namespace std;
 // Set GPIO pin locations
 #define RESET_PIN RPI_BPLUS_GPIO_J8_07
 #define TEST_PIN  RPI_BPLUS_GPIO_J8_11
+#define BUTTON_CHIP "/dev/gpiochip0"   // character device carrying TEST_PIN
+#define BUTTON_LINE 17                  // BCM line number of TEST_PIN
+#define BUTTON_DEBOUNCE_MS 20   // the button has to still be down this long after its edge
+#define BUTTON_POLL_MS     10   // level polling interval when there is no edge source
 #define T1_PIN RPI_BPLUS_GPIO_J8_13
 #define T2_PIN RPI_BPLUS_GPIO_J8_15
 #define T3_PIN RPI_BPLUS_GPIO_J8_16
@@ -64,39 +113,105 @@ using namespace std;
 #define VMAX 5.00 //value for testing right now, can change based upon range
 #define ADCMAX 3972 //3972
 
-// Samples and floating-point samples
-#define SAMPLES 500
-#define SAMPLESF 500.0
-
-// global arrays
-double volts_ct[SAMPLES]; //x-axis value storage (decimal values from 0-VMAX, to be graphed)
-int volts_adc[SAMPLES]; //values to send to DAC from 0-4095
-double curr[SAMPLES]; //y-axis value storage
+// Simulated part defaults
+#define SIM_NOISE   2.0         // ADC noise, LSB rms
+#define SIM_VTH     2.0         // MOSFET threshold magnitude, V
+#define SIM_KP      0.2         // MOSFET transconductance parameter, A/V^2
+#define SIM_LAMBDA  0.02        // MOSFET channel length modulation, 1/V
+#define SIM_IS      1e-14       // diode and BJT saturation current, A
+#define SIM_BF      150.0       // BJT forward beta
+#define SIM_BR      5.0         // BJT reverse beta
+#define SIM_VT      0.02585     // thermal voltage, V
+#define SIM_FRAME_US 4.1        // one 16-bit frame at the spidev clock, us
+#define SIM_BOUNCES  3          // contact bounce edges of a simulated button press
+#define SIM_HOLD_MS  200        // how long a simulated press holds the button down
 
-// global counter
-int xAxisCnt;
-
-// fixed globals used for curve trace
-double voltsVDS[SAMPLES];
+// Sweep specification: curve steps, points per curve and VDS/VCE span
+#define MAX_CURVES 16
+#define MAX_POINTS 65535        // per curve, the ring records and raw curves index the grid in 16 bits
+struct sweepSpec{
+    const char *name;
+    int points;                 // VDS/VCE points per curve
+    float span;                 // VDS/VCE span, V
+    int mosCurves;
+    float mos[MAX_CURVES];      // NMOS gate voltages, PMOS runs VMAX minus these
+    int bjtCurves;
+    float bjt[MAX_CURVES];      // NPN base voltages, PNP runs VMAX minus these
+};
+
+const sweepSpec sweepPresets[] = {
+    {"full",   500, VMAX, 6, {0.0, 1.0, 2.0, 3.0, 4.0, 5.0}, 6, {0.0, 0.5, 1.0, 1.5, 2.0, 2.5}},
+    {"quick",  100, VMAX, 4, {2.0, 3.0, 4.0, 5.0},           4, {0.5, 1.0, 1.5, 2.0}},
+    {"lab",   2000, VMAX, 6, {0.0, 1.0, 2.0, 3.0, 4.0, 5.0}, 6, {0.0, 0.5, 1.0, 1.5, 2.0, 2.5}},
+};
+sweepSpec spec = sweepPresets[0];
+
+// global arrays, sized from spec.points by sweep_alloc
+thread_local double *volts_ct; //x-axis value storage (decimal values from 0-VMAX, to be graphed)
+thread_local int *volts_adc; //values to send to DAC from 0-4095
+thread_local double *curr; //y-axis value storage
+
+thread_local int curvePoints;    // entries of voltsVDS/curr holding the current curve
+
+// Adaptive sweep grid
+#define ADAPT_COARSE 16     // intervals in the starting grid
+#define ADAPT_TOL    0.002  // chord deviation that triggers refinement, fraction of full scale
+#define ADAPT_BUDGET 150    // measured points per curve
+int adaptive = 0;
+double adaptTol = ADAPT_TOL;
+int adaptBudget = ADAPT_BUDGET;
+// Progressive sweep: every PROGRESSIVE_STEP-th point of every curve first, then the points halfway between in
+// passes of halving step, with a preview published after each pass
+#define PROGRESSIVE_STEP 16
+int progressive = 0;
+thread_local int sweepSamples = SWEEP_SAMPLES;  // per point, unless adaptive averaging sets its own; live mode lowers it
+thread_local int sweepReadGate = 0;     // transfer sweeps also read the gate/base terminal
+thread_local int gateRead, gateTerminal;    // its mean ADC code and which terminal it is
+thread_local char *measured;
+thread_local int *measuredIdx;
+thread_local double *probeVDS;   // converted points the adaptive grid refines on, acquisition side
+thread_local double *probeCurr;
+
+// fixed globals used for curve trace, processing side
+thread_local double *voltsVDS;
+thread_local char *received;     // points of the current curve that came through the sweep ring
+
+// The processing side keeps each curve as the 12-bit codes it was measured with and converts them to volts and
+// amps only for the CSV; a trace stores the codes themselves.
+struct rawCurve{
+    uint16_t *point;            // grid point
+    uint16_t *src, *drn;        // mean ADC codes of source/emitter and drain/collector
+    uint16_t *dac;              // DAC code on drain/collector
+    uint16_t *samples;          // ADC samples averaged per channel
+};
+thread_local rawCurve raw;
 
 // More globals, we love these (bad programmer, BAD!)
-int mosfet[3]; //simulated MOSFET: then Type
-int volts[3];
-int terminal_id[3] = {0,0,0};
-int buttonRead = 1;
-float vgsCorrected;
-float PbjtBase[6] = {5.0, 4.5, 4.0, 3.5, 3.0, 2.5};
-float NbjtBase[6] = {0.0, 0.5, 1.0, 1.5, 2.0, 2.5};
+thread_local int mosfet[3]; //simulated MOSFET: then Type
+thread_local int volts[3];
+thread_local int terminal_id[3] = {0,0,0};
+int buttonDebounce = BUTTON_DEBOUNCE_MS;
+int buttonTimeout = 0;      // ms, 0 = wait for the button forever
+int buttonRejected = 0;     // edges of the last wait that didn't hold down past the debounce
+thread_local float vgsCorrected;
 // float NMOSgate[6] = {2.0, 2.2, 2.4, 2.6, 2.8, 3.0}; // For testing
 
-int calVolts;   // Calibration level voltage
+thread_local int calVolts;   // Calibration level voltage
 
 //file name
-char fname[1000];
-
-// I/O data variables
-char spiOut[2];
-char spiIn[2] = {0, 0};
+thread_local char fname[1000];
+int traceOut = 0;   // --trace: curves go to a binary .trc instead of the CSV
+
+// What plots each test's curves: the native renderer (PNG and SVG next to the curve file), curve.py, or the
+// long-lived plotd.py worker
+#define PLOT_NONE   0
+#define PLOT_NATIVE 1
+#define PLOT_PYTHON 2
+#define PLOT_WORKER 3
+#define PLOT_XMAX   4.85    // right end of curve.py's x axis
+int plotMode = -1;          // -1 = native on the Pi, none elsewhere
+thread_local plotFigure figure;     // this test's curves, filled by the processing thread
+thread_local double *plotBuf;       // their values, x then y per curve
 
 // Create two byte-size packets from 16-bit word for transmission to 5592
 void makeWord(char eightBits[], unsigned short sixteenBits)
@@ -104,1844 +219,2152 @@ void makeWord(char eightBits[], unsigned short sixteenBits)
 	eightBits[0] = sixteenBits >> 8;
 	eightBits[1] = sixteenBits & 0x00FF;
 }
-
-// Pull ground level for ADC from this function
-int AD5592_calibration(void){
 
-    // Set all voltages to ground
-    int calVoltage = GROUNDED;
-    int gndRead = 0;
-    int gndReadMax = 0;
-    int i = 0; // counter
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    // ground all DACs
-    spiOut[0] = (calVoltage | DAC0_WRITE) >> 8;   // Term 1
-    spiOut[1] = (calVoltage | DAC0_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+                                                                SPI Transport
 
-    spiOut[0] = (calVoltage | DAC1_WRITE) >> 8;   // Term 2
-    spiOut[1] = (calVoltage | DAC1_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
 
-    spiOut[0] = (calVoltage | DAC2_WRITE) >> 8;   // Term 3
-    spiOut[1] = (calVoltage | DAC2_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Register-level AD5592 model, answers the same 16-bit frames the firmware clocks out (DAC writes, ADC sequence, no-ops)
+thread_local int simDac[8];          // DAC register contents
+thread_local int simSequence = 0;    // ADC channels selected by the last sequence write
+thread_local int simRepeat = 0;      // REP bit of the last sequence write
+thread_local int simChannel = 8;     // next channel to convert, 8 = sequence finished
+thread_local int simPending = NOOP;  // word clocked out on the next frame
+
+// Part in the simulated test socket, wired to the DACs through the RESISTOR network
+thread_local int simPart = TBD;                      // NMOS, PMOS, NPN, PNP, TBD = empty socket
+thread_local int simRole[3] = {TBD, TBD, TBD};       // role of terminals 1..3 (GATE/SOURCE/DRAIN or BASE/COLLECTOR/EMITTER)
+double simNoise = SIM_NOISE;            // ADC noise, LSB rms
+thread_local unsigned int simSeed = 1;               // noise generator state
+unsigned int simSeedBase = 1;           // --seed, socket k starts its generator at simSeedBase + k
+int simClock = 0;                       // transfers take as long as the real frames would
+thread_local double simNode[3];                      // solved terminal voltages
+thread_local int simSolved = 0;                      // simNode is valid for the current DAC values
+double simTau = 0;                      // terminal settling time constant, us, 0 = instant
+thread_local double simSeen[3];                      // terminal voltages the ADC sees while settling
+thread_local struct timespec simLast;                // end of the last transfer
+int simPress = 0;                       // ms between simulated button presses, 0 = button held down
+volatile int simLevel = 0;              // simulated button level, 0 = pressed
+int simEdges[2] = {-1, -1};             // pipe carrying the simulated button's falling edges
+
+// Exponential that turns linear past exp(40) so Newton steps can't overflow
+double sim_exp(double x){
+    if(x > 40.0){
+        return exp(40.0) * (1.0 + x - 40.0);
+    }
+    return exp(x);
+}
 
-    for(i = 0; i < 90; i++){ // average ADC1 readings (30)
-            makeWord(spiOut, 0b0000000000000000); //no op command, data in garbage
-            bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE); // no op again, should be good ADC1 data
-            spiIn[0] = spiIn[0] & 0x0F;
-            gndRead = spiIn[0]; // Place result into read-out array
-            gndRead = (gndRead << 8) | spiIn[1];
+// Shockley diode current for forward voltage v
+double sim_diode(double v){
+    return SIM_IS * (sim_exp(v / SIM_VT) - 1.0);
+}
 
-            // Grab maximum ground value
-            if (gndRead > gndReadMax){
-                gndReadMax = gndRead;
+// Square-law NMOS drain current, vds >= 0
+double sim_mos_channel(double vgs, double vds){
+    double vov = vgs - SIM_VTH;
+
+    if(vov <= 0){
+        return 0;
+    }
+    if(vds < vov){
+        return SIM_KP * (vov * vds - vds * vds / 2) * (1 + SIM_LAMBDA * vds);   // triode
+    }
+    return SIM_KP / 2 * vov * vov * (1 + SIM_LAMBDA * vds);                   // saturation
+}
+
+// NMOS with source-drain body diode, currents flowing into each terminal
+void sim_nmos(double vg, double vd, double vs, double *ig, double *id, double *is){
+    double ich, idio;
+
+    // the channel is symmetric, whichever end is lower acts as the source
+    if(vd >= vs){
+        ich = sim_mos_channel(vg - vs, vd - vs);
+    }
+    else{
+        ich = -sim_mos_channel(vg - vd, vs - vd);
+    }
+    idio = sim_diode(vs - vd);
+
+    *ig = 0;
+    *id = ich - idio;
+    *is = idio - ich;
+}
+
+// Ebers-Moll transport model NPN, currents flowing into each terminal
+void sim_npn(double vb, double vc, double ve, double *ib, double *ic, double *ie){
+    double ef = sim_exp((vb - ve) / SIM_VT) - 1.0;
+    double er = sim_exp((vb - vc) / SIM_VT) - 1.0;
+
+    *ib = SIM_IS / SIM_BF * ef + SIM_IS / SIM_BR * er;
+    *ic = SIM_IS * (ef - er) - SIM_IS / SIM_BR * er;
+    *ie = -(*ib + *ic);
+}
+
+// Currents into terminals 1..3 of the simulated part at terminal voltages v
+void sim_part_currents(const double v[3], double cur[3]){
+    double sign = (simPart == PMOS || simPart == PNP) ? -1.0 : 1.0;    // P types are the N models mirrored
+    double vr[3], ir[3];
+    int role[13];
+
+    cur[0] = 0; cur[1] = 0; cur[2] = 0;
+    for(int k = 0; k < 3; k++){
+        role[simRole[k]] = k;
+    }
+
+    switch(simPart){
+        case NMOS:
+        case PMOS:
+            for(int k = 0; k < 3; k++){
+                vr[k] = sign * v[role[GATE + k]];   // GATE, SOURCE, DRAIN
             }
-        }
-
-    // return base ground level
-    return abs(gndReadMax);
+            sim_nmos(vr[0], vr[2], vr[1], &ir[0], &ir[2], &ir[1]);
+            for(int k = 0; k < 3; k++){
+                cur[role[GATE + k]] = sign * ir[k];
+            }
+            break;
+        case NPN:
+        case PNP:
+            for(int k = 0; k < 3; k++){
+                vr[k] = sign * v[role[BASE + k]];   // BASE, COLLECTOR, EMITTER
+            }
+            sim_npn(vr[0], vr[1], vr[2], &ir[0], &ir[1], &ir[2]);
+            for(int k = 0; k < 3; k++){
+                cur[role[BASE + k]] = sign * ir[k];
+            }
+            break;
+        default:
+            break;
+    }
 }
 
-// Cycles voltages to identify gate terminal (or lack thereof) on a MOSFET
-int volt_cycle(int tone, int ttwo, int tthree){
-
-    // variables used for ADC reads and math
-    int m1, m2, m3, c1=0, c2=0, c3=0;
-    int cnt = 0, ADC1cnt = 0, ADC2cnt = 0, ADC3cnt = 0;
-    int ADC1read = 0, ADC2read = 0, ADC3read = 0;
-    int ADC1readSum = 0, ADC2readSum = 0, ADC3readSum = 0;
-    int ADC1drop = 0, ADC2drop = 0, ADC3drop = 0;
-
-    // checks source of the incoming ADC data
-    int spiInCheck = 0;
-
-    // counters
-    int mos_cnt = 0; int bjt_cnt = 0;
-    int c1_cnt = 0; int c2_cnt = 0; int c3_cnt = 0;
-
-    // voltages defined in globals, self-explanatory
-    volts[0] = FIVE_VOLTS;
-    volts[1] = ONE_VOLT;
-    volts[2] = GROUNDED;
+// Solve the terminal node voltages: DAC -> RESISTOR -> terminal, with the part's currents leaving each node
+void sim_solve(void){
+    int termDac[3] = {0, 1, 3};
+    double vdac[3], f[3], fd[3], jac[3][4], dx[3], x[3], cur[3];
+    double step;
 
-    for(int kk = 0; kk<29; kk++){
+    for(int k = 0; k < 3; k++){
+        vdac[k] = simDac[termDac[k]] * VMAX / 4095.0;
+        simNode[k] = vdac[k];
+    }
+    if(simPart == TBD){
+        simSolved = 1;
+        return;
+    }
 
-        c1 = 0; c2 = 0; c3 = 0;
+    for(int iter = 0; iter < 200; iter++){
+        sim_part_currents(simNode, cur);
+        for(int k = 0; k < 3; k++){
+            f[k] = (vdac[k] - simNode[k]) / RESISTOR - cur[k];
+        }
 
-        sort(volts, volts+3);
+        // numerical Jacobian, right-hand side in column 3
+        for(int j = 0; j < 3; j++){
+            for(int k = 0; k < 3; k++){
+                x[k] = simNode[k];
+            }
+            x[j] += 1e-6;
+            sim_part_currents(x, cur);
+            for(int k = 0; k < 3; k++){
+                fd[k] = (vdac[k] - x[k]) / RESISTOR - cur[k];
+                jac[k][j] = (fd[k] - f[k]) / 1e-6;
+            }
+        }
+        for(int k = 0; k < 3; k++){
+            jac[k][3] = -f[k];
+        }
 
-	do{
+        // Gaussian elimination with partial pivoting
+        for(int p = 0; p < 3; p++){
+            int best = p;
+            for(int r = p + 1; r < 3; r++){
+                if(fabs(jac[r][p]) > fabs(jac[best][p])){
+                    best = r;
+                }
+            }
+            for(int c = 0; c < 4; c++){
+                swap(jac[p][c], jac[best][c]);
+            }
+            for(int r = p + 1; r < 3; r++){
+                double m = jac[r][p] / jac[p][p];
+                for(int c = p; c < 4; c++){
+                    jac[r][c] -= m * jac[p][c];
+                }
+            }
+        }
+        for(int p = 2; p >= 0; p--){
+            dx[p] = jac[p][3];
+            for(int c = p + 1; c < 3; c++){
+                dx[p] -= jac[p][c] * dx[c];
+            }
+            dx[p] /= jac[p][p];
+        }
 
-        ADC1cnt = 0;
-        ADC1readSum = 0;
-        ADC2cnt = 0;
-        ADC2readSum = 0;
-        ADC3cnt = 0;
-        ADC3readSum = 0;
+        // limit each step so the exponentials stay tame
+        step = 0;
+        for(int k = 0; k < 3; k++){
+            dx[k] = max(-0.1, min(0.1, dx[k]));
+            simNode[k] += dx[k];
+            step = max(step, fabs(dx[k]));
+        }
+        if(step < 1e-9){
+            break;
+        }
+    }
+    simSolved = 1;
+}
 
-        // write data to DACs
-        spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-        spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Unit normal deviate for the ADC noise (Box-Muller)
+double sim_gauss(void){
+    double u1 = (rand_r(&simSeed) + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand_r(&simSeed) + 1.0) / (RAND_MAX + 2.0);
 
-        spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-        spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
 
-        spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-        spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Voltage (as a 12-bit code) seen by ADC channel ch -- terminals 1/2/3 are driven by DAC0/1/3 and read back on ADC4/5/6
+int sim_adc_input(int ch){
+    int code;
 
-        spiOut[0] = ADCSEQUENCE >> 8;
-        spiOut[1] = ADCSEQUENCE & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(ch < 4 || ch > 6){
+        return 0;
+    }
+    if(!simSolved){
+        sim_solve();
+    }
+    code = (int)lround((simTau > 0 ? simSeen[ch - 4] : simNode[ch - 4]) / VMAX * 4095.0 + simNoise * sim_gauss());
+    return max(0, min(4095, code));
+}
 
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Step to the next channel of the sequence, wrapping around when REP is set
+void sim_next_channel(void){
+    int ch;
 
-/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+    for(ch = simChannel + 1; ch < 8; ch++){
+        if(simSequence & (1 << ch)){
+            simChannel = ch;
+            return;
+        }
+    }
+    for(ch = 0; simRepeat && ch < 8; ch++){
+        if(simSequence & (1 << ch)){
+            simChannel = ch;
+            return;
+        }
+    }
+    simChannel = 8;
+}
 
-                                                                ADC Reads
+// Power-on register state of the model
+void sim_power_on(void){
+    for(int ch = 0; ch < 8; ch++){
+        simDac[ch] = 0;
+    }
+    simSequence = 0;
+    simRepeat = 0;
+    simChannel = 8;
+    simPending = NOOP;
+    simSolved = 0;
+    simSeen[0] = 0; simSeen[1] = 0; simSeen[2] = 0;
+}
 
------------------------------------------------------------------------------------------------------------------------------------------------------------------------------- */
+// Clock one frame into the model and return the frame it shifts out
+unsigned short sim_AD5592_frame(unsigned short word){
+    unsigned short out = simPending;
 
-        // printf("Volts: %d %d %d\n", volts[0], volts[1], volts[2]);
+    // terminals move one frame closer to their solved voltages
+    if(simTau > 0){
+        if(!simSolved){
+            sim_solve();
+        }
+        for(int k = 0; k < 3; k++){
+            simSeen[k] += (simNode[k] - simSeen[k]) * (1.0 - exp(-SIM_FRAME_US / simTau));
+        }
+    }
 
-        for(cnt = 0; cnt < 90; cnt++){
+    if(word == RESET){  // software reset
+        sim_power_on();
+        return out;
+    }
+    if(word & 0x8000){  // DAC write
+        simDac[(word >> 12) & 0x07] = word & 0x0FFF;
+        simSolved = 0;
+    }
+    else if(((word >> 11) & 0x0F) == ((ADCSEQUENCE >> 11) & 0x0F)){ // ADC sequence register
+        simSequence = word & 0x00FF;
+        simRepeat = (word >> 9) & 0x01;
+        simChannel = -1;
+        sim_next_channel();
+        simPending = NOOP;  // first frame after a sequence write carries no conversion
+        return out;
+    }
 
-            makeWord(spiOut, 0b0000000000000000); //no op command, data in
-            bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-            spiInCheck = (spiIn[0] >> 4) & 0x07;
-            // printf("spiCheck: %d\n", spiInCheck);
+    if(simChannel < 8){
+        simPending = (simChannel << 12) | (sim_adc_input(simChannel) & 0x0FFF);
+        sim_next_channel();
+    }
+    else{
+        simPending = NOOP;
+    }
+    return out;
+}
 
-            if(spiInCheck == 4){
-                spiIn[0] = spiIn[0] & 0x0F;
-                ADC1read = spiIn[0]; // Place result into read-out array
-                ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                ADC1readSum += ADC1read;
-                ADC1cnt++;
-                //printf("ADC1: %d\n", ADC1read);
-            }
+// Send a batch of frames to the simulated AD5592, replies overwrite the buffer in place
+void sim_AD5592_transfer(char *buf, int words){
+    struct timespec until;
+    double idle;
 
-            else if(spiInCheck == 5){
-                spiIn[0] = spiIn[0] & 0x0F;
-                ADC2read = spiIn[0]; // Place result into read-out array
-                ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                ADC2readSum += ADC2read;
-                ADC2cnt++;
-            }
+    clock_gettime(CLOCK_MONOTONIC, &until);
 
-            else if(spiInCheck == 6){
-                spiIn[0] = spiIn[0] & 0x0F;
-                ADC3read = spiIn[0]; // Place result into read-out array
-                ADC3read = (ADC3read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                ADC3readSum += ADC3read;
-                ADC3cnt++;
-                // printf("ADC3read: %d\n", ADC3read);
-            }
-            else{
-                // printf("spicheck is %d\n",spiInCheck);
-                ADC1cnt++;
-                ADC2cnt++;
-                ADC3cnt++;
-            }
+    // the terminals also settle while nothing is clocked
+    if(simTau > 0 && simLast.tv_sec != 0){
+        idle = (until.tv_sec - simLast.tv_sec) * 1e6 + (until.tv_nsec - simLast.tv_nsec) / 1e3;
+        if(!simSolved){
+            sim_solve();
+        }
+        for(int k = 0; k < 3; k++){
+            simSeen[k] += (simNode[k] - simSeen[k]) * (1.0 - exp(-idle / simTau));
         }
-        // check the voltage drops across each terminal resistor, write to read variables
-        ADC1read = abs(ADC1readSum / (ADC1cnt));
-        ADC1drop = abs(volts[0] - ADC1read);
+    }
 
-        ADC2read = abs(ADC2readSum / (ADC2cnt));
-        ADC2drop = abs(volts[1] - ADC2read);
+    for(int w = 0; w < words; w++){
+        char *frame = &buf[w*WORD_SIZE];
+        makeWord(frame, sim_AD5592_frame(((frame[0] & 0xFF) << 8) | (frame[1] & 0xFF)));
+    }
 
-        ADC3read = abs(ADC3readSum / (ADC3cnt));
-        ADC3drop = abs(volts[2] - ADC3read);
-
-        // increment counters based on voltage drops -- we're looking for a terminal with no current (i.e. gate)
-		if(ADC1drop < calVolts){c1++;} //note some values will have to change based on number ranges recieved by ADC/DAC
+    // hold the bus for the time the frames take on the wire
+    if(simClock){
+        until.tv_nsec += (long)(words * SIM_FRAME_US * 1000);
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &simLast);
+}
 
-		if(ADC2drop < calVolts){c2++;}
+// Test sockets, each an AD5592 board on its own chip select
+#define MAX_SOCKETS 4
+
+struct tracerSocket{
+    int index;                  // chip select, S<index+1> in file names and on the display
+    pthread_t thread;
+    int done;                   // last test round finished, -1 = failed to start, -2 = starting
+    int type, subtype, id[3];   // result of the last test, type TBD = identification error
+    double idSeconds, sweepSeconds, testSeconds;    // where the last test's time went
+    char file[1000];            // curve file of the last test
+};
+
+tracerSocket sockets[MAX_SOCKETS];
+int socketCount = 1;
+thread_local tracerSocket *sock = &sockets[0];  // socket the calling thread tests
+
+// Bus scheduler: the sockets share SCLK, MOSI and MISO and take the bus in ticket order, one transfer at a time.
+// Busy sockets interleave transfer by transfer, and one socket's processing and waits overlap another's transfers.
+pthread_mutex_t busLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t busFree = PTHREAD_COND_INITIALIZER;
+unsigned busNext = 0, busServing = 0;
+struct timespec busTaken;   // when the holder got the bus
+double busSeconds = 0;      // bus held, all sockets
+
+void bus_acquire(void){
+    pthread_mutex_lock(&busLock);
+    unsigned ticket = busNext++;
+    while(ticket != busServing){
+        pthread_cond_wait(&busFree, &busLock);
+    }
+    pthread_mutex_unlock(&busLock);
+    clock_gettime(CLOCK_MONOTONIC, &busTaken);
+}
 
-		if(ADC3drop < calVolts){c3++;}
-	} while (next_permutation(volts, volts+3)); // run through all possible voltage permutations
-
-    // some summing variables
-	c1_cnt += c1; c2_cnt += c2; c3_cnt += c3;
-
-    // is there a gate?
-    if( ((c1 == 6) || (c2 == 6) || (c3 == 6)) ){
-        // printf("%d, %d, %d\n", c1, c2, c3);
-		mos_cnt++;
-	}
-	// if not, it's a BJT
-	else {
-		bjt_cnt++;
-	}
+void bus_release(void){
+    struct timespec now;
 
-	}
-    // if there's a gate, what terminal is it located on?
-    if (mos_cnt > bjt_cnt){
-        if( (c1_cnt > c2_cnt) && (c1_cnt > c3_cnt) ){
-            return 1;
-        } else if( (c2_cnt > c1_cnt) && (c2_cnt > c3_cnt) ){
-            return 2;
-        } else if( (c3_cnt > c1_cnt) && (c3_cnt > c2_cnt) ){
-            return 3;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&busLock);
+    busSeconds += (now.tv_sec - busTaken.tv_sec) + (now.tv_nsec - busTaken.tv_nsec) / 1e9;
+    busServing++;
+    pthread_cond_broadcast(&busFree);
+    pthread_mutex_unlock(&busLock);
+}
+
+#ifndef AD5592_SIM
+// Clock a batch of frames through SPI0 in one pass, replies overwrite the buffer in place.
+// The AD5592 latches each word on the rising edge of SYNC, so chip select is still released between frames,
+// but the FIFO is cleared once and there is no library round trip per word.
+void SPI_transfer_bcm2835(char *buf, int words){
+    volatile uint32_t* paddr = bcm2835_spi0 + BCM2835_SPI0_CS/4;
+    volatile uint32_t* fifo = bcm2835_spi0 + BCM2835_SPI0_FIFO/4;
+
+    bcm2835_peri_set_bits(paddr, BCM2835_SPI0_CS_CLEAR, BCM2835_SPI0_CS_CLEAR);
+    bcm2835_peri_set_bits(paddr, sock->index, BCM2835_SPI0_CS_CS);         // this socket's chip select
+
+    for(int w = 0; w < words; w++){
+        char *frame = &buf[w*WORD_SIZE];
+
+        bcm2835_peri_set_bits(paddr, BCM2835_SPI0_CS_TA, BCM2835_SPI0_CS_TA);   // assert SYNC
+        bcm2835_peri_write_nb(fifo, frame[0]);
+        bcm2835_peri_write_nb(fifo, frame[1]);
+
+        while(!(bcm2835_peri_read_nb(paddr) & BCM2835_SPI0_CS_DONE))
+            ;
+
+        frame[0] = bcm2835_peri_read_nb(fifo);
+        frame[1] = bcm2835_peri_read_nb(fifo);
+        bcm2835_peri_set_bits(paddr, 0, BCM2835_SPI0_CS_TA);                    // release SYNC, word latched
+    }
+}
+#endif
+
+// Kernel spidev backend
+int spiBackend = SPI_BCM2835;
+thread_local int spiFd = -1;
+char spiDevice[100] = "/dev/spidev0.0";
+
+// Queue a batch as one SPI_IOC_MESSAGE per SPIDEV_MAX_SEGMENTS frames. Each frame is its own segment with
+// cs_change set, so the kernel releases SYNC between words and the controller can DMA the whole queue.
+// -1 if the kernel rejected a message, the replies in buf are then incomplete.
+int SPI_transfer_spidev(char *buf, int words){
+    struct spi_ioc_transfer xfer[SPIDEV_MAX_SEGMENTS];
+    int n, seg;
+
+    while(words > 0){
+        n = min(words, SPIDEV_MAX_SEGMENTS);
+        memset(xfer, 0, n * sizeof(xfer[0]));
+
+        for(seg = 0; seg < n; seg++){
+            xfer[seg].tx_buf = (unsigned long)&buf[seg*WORD_SIZE];
+            xfer[seg].rx_buf = (unsigned long)&buf[seg*WORD_SIZE];
+            xfer[seg].len = WORD_SIZE;
+            xfer[seg].speed_hz = SPIDEV_SPEED;
+            xfer[seg].bits_per_word = 8;
+            xfer[seg].cs_change = (seg < n - 1);    // on the last segment cs_change would hold SYNC low after the message
+        }
+
+        if(ioctl(spiFd, SPI_IOC_MESSAGE(n), xfer) < 0){
+            perror("SPI_IOC_MESSAGE");
+            return -1;
         }
+        buf += n * WORD_SIZE;
+        words -= n;
     }
-	else {
-		return 0;
-	}
+    return 0;
 }
-
-// If the device is a MOSFET, identifies PMOS vs. NMOS device
-int type_finder(int nongate, int gate){
 
-    int m1, m2;
-    int cnt = 0;
-    int nongateRead, nongateReadSum, nongateReadBefore, nongateReadAfter;
-    int nongatecnt = 0;
-    int nongateIO = 0x10 << nongate;
-    int spiInCheck;
+// Hardware the identification and sweep code runs against
+struct tracerDevice{
+    const char *name;
+    int  onPi;                                  // USB stick and curve.py are available
+    int  (*init)(void);                         // bring up buses and GPIOs, -1 on failure
+    void (*transfer)(char *buf, int words);     // clock a batch of AD5592 frames, replies in place
+    void (*reset)(void);                        // hard reset of the AD5592
+    int  (*button)(void);                       // test button level, 0 = pressed
+    int  (*edges)(void);                        // non-blocking fd readable after a button falling edge, -1 = level only
+    void (*display)(int glyph);                 // write one 7-segment glyph
+    void (*wait)(unsigned int ms);
+};
+
+tracerDevice *dev;
+
+// Route a batch to the spidev backend or the device's own transport, -1 on failure
+int AD5592_transfer(char *buf, int words){
+    int res = 0;
+
+    if(socketCount > 1){
+        bus_acquire();
+    }
+    if(spiBackend == SPI_SPIDEV){
+        res = SPI_transfer_spidev(buf, words);
+    }
+    else{
+        dev->transfer(buf, words);
+    }
+    if(socketCount > 1){
+        bus_release();
+    }
+    return res;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    // create new ADC sequence from nongate terminal number
-    int newADCSequence = (ADCSEQUENCE & 0b0001001000000000) | nongateIO;
+                                                                Real-Time Acquisition
 
-    // ground entire voltage array (temporary)
-    volts[0] = GROUNDED;
-    volts[1] = GROUNDED;
-    volts[2] = GROUNDED;
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// --rt moves the thread that drives the bus onto its own core under SCHED_FIFO with all memory locked, and the
+// display, button and processing threads off that core. Either way the sweep records the idle gap between
+// transfers and the time from a DAC change to its settled read, in 1 us buckets, and reports p50/p99/max.
+#define RT_PRIORITY 80
+#define RT_STACK    (256 * 1024)    // stack prefaulted before the sweep
+#define LAT_BUCKETS 10000           // 1 us each, the last one collects everything slower
+
+int rtMode = 0;
+int rtCpu = -1;     // core of the acquisition thread, -1 = last online core
+
+struct latHist{
+    long n;
+    long count[LAT_BUCKETS];
+    double max;     // us
+};
+
+thread_local latHist latGap;     // end of one transfer to the start of the next
+thread_local latHist latSettle;  // start of a measurement to its settled read
+thread_local int latRecording = 0;
+thread_local struct timespec latLast;    // end of the last recorded transfer
+thread_local int latHaveLast = 0;
+
+void lat_add(latHist *h, double us){
+    int b = max(0, min(LAT_BUCKETS - 1, (int)us));
+
+    h->count[b]++;
+    h->n++;
+    h->max = max(h->max, us);
+}
 
-    // move proper voltages to gate and random non-gate terminal
-    volts[gate] = FIVE_VOLTS;
-    volts[nongate] = ONE_VOLT;
+// upper edge of the bucket holding quantile q, the exact maximum for the overflow bucket
+double lat_quantile(latHist *h, double q){
+    long seen = 0, need = (long)ceil(q * h->n);
 
-    // write data to DACs
-    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    for(int b = 0; b < LAT_BUCKETS - 1; b++){
+        seen += h->count[b];
+        if(seen >= need){
+            return min(h->max, b + 1.0);
+        }
+    }
+    return h->max;
+}
 
-    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// start recording, from an empty histogram
+void lat_start(void){
+    memset(&latGap, 0, sizeof(latGap));
+    memset(&latSettle, 0, sizeof(latSettle));
+    latHaveLast = 0;
+    latRecording = 1;
+}
 
-    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+void lat_report(void){
+    latRecording = 0;
+    if(latGap.n == 0){
+        return;
+    }
+    if(rtMode){
+        printf("Acquisition (SCHED_FIFO on cpu %d):", rtCpu);
+    }
+    else{
+        printf("Acquisition:");
+    }
+    printf(" transfer gap p50 %.0f p99 %.0f max %.0f us, settle-to-read p50 %.0f p99 %.0f max %.0f us, jitter p99 %.0f max %.0f us\n",
+           lat_quantile(&latGap, 0.5), lat_quantile(&latGap, 0.99), latGap.max,
+           lat_quantile(&latSettle, 0.5), lat_quantile(&latSettle, 0.99), latSettle.max,
+           lat_quantile(&latGap, 0.99) - lat_quantile(&latGap, 0.5), latGap.max - lat_quantile(&latGap, 0.5));
+}
 
-    spiOut[0] = newADCSequence >> 8;
-    spiOut[1] = newADCSequence & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Make the calling thread the real-time acquisition thread, once at startup. Threads started afterwards
+// inherit the policy and must call rt_release. Steps the system refuses are reported and skipped.
+void rt_enter(void){
+    cpu_set_t cpus;
+    struct sched_param param;
+    volatile char stack[RT_STACK];
 
-    makeWord(spiOut, 0b0000000000000000); //no op command, garbage in
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(rtCpu < 0){
+        rtCpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    }
+    if(sysconf(_SC_NPROCESSORS_ONLN) < 2){
+        printf("Only one core, the processing and display threads will queue behind the acquisition.\n");
+    }
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0){
+        perror("mlockall");
+    }
+    memset((char *)stack, 0, sizeof(stack));
 
-    for(cnt = 0; cnt < 30; cnt++){
+    CPU_ZERO(&cpus);
+    CPU_SET(rtCpu, &cpus);
+    if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0){
+        printf("Can't pin the acquisition thread to cpu %d.\n", rtCpu);
+    }
+    param.sched_priority = RT_PRIORITY;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0){
+        printf("Can't run the acquisition thread under SCHED_FIFO (needs root or CAP_SYS_NICE).\n");
+    }
+}
 
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-        spiInCheck = (spiIn[0] >> 4) & 0x07;
-        // printf("spiCheck: %d\n", spiInCheck);
+// Helper threads: back to normal scheduling, on any core but the acquisition one
+void rt_release(void){
+    cpu_set_t cpus;
+    struct sched_param param;
+    int n = sysconf(_SC_NPROCESSORS_ONLN);
 
-        if(spiInCheck == nongate + 4){
-            spiIn[0] = spiIn[0] & 0x0F;
-            nongateRead = spiIn[0]; // Place result into read-out array
-            nongateRead = (nongateRead << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-            nongateReadSum += nongateRead;
-            nongatecnt++;
-            //printf("ADC1: %d\n", ADC1read);
+    if(!rtMode){
+        return;
+    }
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    if(n > 1){
+        CPU_ZERO(&cpus);
+        for(int c = 0; c < n; c++){
+            if(c != rtCpu){
+                CPU_SET(c, &cpus);
+            }
         }
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
     }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Batched Measurements
 
-    // get before value (drop) of nongate terminal
-    nongateReadBefore = abs(volts[nongate] - (nongateReadSum / nongatecnt));
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// Command stream for one measurement point, sent as a single transfer
+thread_local char batchBuf[BATCH_MAX_WORDS * WORD_SIZE];
+thread_local int batchWords = 0;
+
+// ADC readings demultiplexed out of a batch by channel tag
+struct adcBatch{
+    int sum[8];     // sum of 12-bit codes per channel
+    int cnt[8];     // number of codes per channel
+    int words;      // number of read slots demultiplexed
+};
+
+// Start a new command stream
+void batch_clear(void){
+    batchWords = 0;
+}
+
+// Append one 16-bit command to the stream
+void batch_word(unsigned short word){
+    if(batchWords >= BATCH_MAX_WORDS){
+        // every caller sizes its batch to fit, a short batch would be demuxed as if it were complete
+        printf("SPI batch overflow: more than %d words.\n", BATCH_MAX_WORDS);
+        abort();
+    }
+    makeWord(&batchBuf[batchWords*WORD_SIZE], word);
+    batchWords++;
+}
 
-    // ground the gate, transfer to DACs, wait 10 ms for gate capacitance to discharge
-    volts[gate] = GROUNDED;
+// Shadow copy of the AD5592 registers the measurements rewrite, -1 = unknown
+thread_local int shadowDac[3] = {-1, -1, -1};
+thread_local int shadowSequence = -1;
+thread_local long shadowSent = 0;        // DAC and sequence writes clocked out
+thread_local long shadowSkipped = 0;     // writes dropped because the register already held the value
 
-    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Forget the register contents, e.g. after a hard reset
+void shadow_invalidate(void){
+    shadowDac[0] = -1; shadowDac[1] = -1; shadowDac[2] = -1;
+    shadowSequence = -1;
+}
 
-    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Append a DAC write for terminal k unless the DAC already holds code
+void batch_dac(int k, int code){
+    int dacWrite[3] = {DAC0_WRITE, DAC1_WRITE, DAC2_WRITE};
 
-    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(shadowDac[k] == code){
+        shadowSkipped++;
+        return;
+    }
+    batch_word(code | dacWrite[k]);
+    shadowDac[k] = code;
+    shadowSent++;
+}
 
-    delay(10);
+// Append the ADC sequence write unless it is already programmed, returns 1 if it was written
+int batch_sequence(int sequence){
+    if(shadowSequence == sequence){
+        shadowSkipped++;
+        return 0;
+    }
+    batch_word(sequence);
+    shadowSequence = sequence;
+    shadowSent++;
+    return 1;
+}
 
-    // null critical variables
-    nongatecnt = 0;
-    nongateReadSum = 0;
+// Append the DAC writes the current volts[] array needs
+void batch_dacs(void){
+    batch_dac(0, volts[0]);     // Term 1
+    batch_dac(1, volts[1]);     // Term 2
+    batch_dac(2, volts[2]);     // Term 3
+}
 
-    // check values again
-    for(cnt = 0; cnt < 30; cnt++){
+// Append n no-op read slots
+void batch_noops(int n){
+    for(int i = 0; i < n; i++){
+        batch_word(NOOP);
+    }
+}
 
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-        spiInCheck = (spiIn[0] >> 4) & 0x07;
-        // printf("spiCheck: %d\n", spiInCheck);
+// Per-channel sample scheduler statistics
+thread_local long adcSamples[8];         // samples taken on each channel
+thread_local double adcSeconds[8];       // bus time of the transfers that sampled each channel
+thread_local double batchSeconds = 0;    // duration of the last transfer
+thread_local int spiFailed = 0;          // a transfer of this socket's test failed, the rest of the test is void
+
+// Send the whole stream in one transfer. On failure, or once an earlier transfer of the test failed, the batch
+// is emptied so nothing demuxes the command words as readings, and -1 tells the caller to stop.
+int batch_send(void){
+    struct timespec start, stop;
+    int res;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    res = spiFailed ? -1 : AD5592_transfer(batchBuf, batchWords);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    if(res < 0){
+        spiFailed = 1;
+        batchWords = 0;
+        return -1;
+    }
+    batchSeconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
 
-        if(spiInCheck == nongate + 4){
-            spiIn[0] = spiIn[0] & 0x0F;
-            nongateRead = spiIn[0]; // Place result into read-out array
-            nongateRead = (nongateRead << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-            nongateReadSum += nongateRead;
-            nongatecnt++;
-            //printf("ADC1: %d\n", ADC1read);
+    if(latRecording){
+        if(latHaveLast){
+            lat_add(&latGap, (start.tv_sec - latLast.tv_sec) * 1e6 + (start.tv_nsec - latLast.tv_nsec) / 1e3);
         }
+        latLast = stop;
+        latHaveLast = 1;
     }
+    return 0;
+}
 
-    nongateReadAfter = abs(volts[nongate] - (nongateReadSum / nongatecnt));
-
-    // did the voltage increase or decrease?
-    // decrease ->
-    if (nongateReadBefore > nongateReadAfter){
-        return NMOS;
-    }
-    // increase ->
-    else if (nongateReadBefore < nongateReadAfter){
-        return PMOS;
+// Channel tag of the ith reply word
+int batch_tag(int i){
+    return (batchBuf[i*WORD_SIZE] >> 4) & 0x07;
+}
+
+// 12-bit ADC code of the ith reply word
+int batch_code(int i){
+    return ((batchBuf[i*WORD_SIZE] & 0x0F) << 8) | (batchBuf[i*WORD_SIZE + 1] & 0xFF);
+}
+
+// Sort the reply words from index first onward into per-channel sums and counts
+void batch_demux(int first, adcBatch *res){
+    int tag;
+
+    for(int ch = 0; ch < 8; ch++){
+        res->sum[ch] = 0;
+        res->cnt[ch] = 0;
     }
-    else{
-        return TBD;
+    res->words = 0;
+
+    for(int i = first; i < batchWords; i++){
+        tag = batch_tag(i);
+        res->sum[tag] += batch_code(i);
+        res->cnt[tag]++;
+        res->words++;
     }
 
+    for(int ch = 0; ch < 8; ch++){
+        if(res->cnt[ch] > 0){
+            adcSamples[ch] += res->cnt[ch];
+            adcSeconds[ch] += batchSeconds;
+        }
+    }
 }
-
-// Operates 7-segment LED after device type, subtype, and terminals have been identified
-void Sev_seg_disp(int type, int sub, int t1, int t2, int t3, int fd){
-
-    printf("\nOutputting data to 7-segment display...\n");
 
-	switch(type){
-		case BJT:
-			wiringPiI2CWrite(fd, 131); //letter b
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 225); //letter J
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 135); //letter T
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 127); //decimal
-			delay(SEGDELAY);
-			switch(sub){
-				case NPN:
-					wiringPiI2CWrite(fd, 171); //letter n
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 140); //letter P
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 171); //letter n
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 127); //decimal
-					delay(SEGDELAY);
-					break;
-				case PNP:
-					wiringPiI2CWrite(fd, 140); //letter P
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 171); //letter n
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 140); //letter P
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 127); //decimal
-					delay(SEGDELAY);
-					break;
-				default:
-					wiringPiI2CWrite(fd, 255); //display blank
-					break;
-			}
-			switch(t1){
-						case BASE:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 131); //letter b
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case COLLECTOR:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 198); //letter C
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case EMITTER:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 134); //letter E
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-					switch(t2){
-						case BASE:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 131); //letter b
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case COLLECTOR:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 198); //letter C
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case EMITTER:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 134); //letter E
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-					switch(t3){
-						case BASE:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 131); //letter b
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case COLLECTOR:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 198); //letter C
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case EMITTER:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 134); //letter E
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-			break;
-		case MOSFET:
-			wiringPiI2CWrite(fd, 142); //letter F
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 134); //letter E
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 135); //letter T
-			delay(SEGDELAY);
-			wiringPiI2CWrite(fd, 127); //decimal
-			delay(SEGDELAY);
-			switch(sub){
-				case NMOS:
-					wiringPiI2CWrite(fd, 171); //letter n
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 127); //decimal
-					delay(SEGDELAY);
-					break;
-				case PMOS:
-					wiringPiI2CWrite(fd, 140); //letter P
-					delay(SEGDELAY);
-					wiringPiI2CWrite(fd, 127); //decimal
-					delay(SEGDELAY);
-					break;
-				default:
-					wiringPiI2CWrite(fd, 255); //display blank
-					break;
-			}
-			switch(t1){
-						case GATE:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 130); //letter G
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case DRAIN:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 161); //letter d
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case SOURCE:
-							wiringPiI2CWrite(fd, 249); //number 1
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 146); //letter S
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-					switch(t2){
-						case GATE:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 130); //letter G
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case DRAIN:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 161); //letter d
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case SOURCE:
-							wiringPiI2CWrite(fd, 164); //number 2
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 146); //letter S
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-					switch(t3){
-						case GATE:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 130); //letter G
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case DRAIN:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 161); //letter d
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						case SOURCE:
-							wiringPiI2CWrite(fd, 176); //number 3
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 146); //letter S
-							delay(SEGDELAY);
-							wiringPiI2CWrite(fd, 127); //decimal
-							delay(SEGDELAY);
-							break;
-						default:
-							wiringPiI2CWrite(fd, 255); //display blank
-							break;
-					}
-			break;
-		default:
-			wiringPiI2CWrite(fd, 255); //display blank
-			break;
-	}
-}
-
-// Displays component data to terminal
-int display_id(int one, int two, int three, int type, int subtype){
-    switch(type){
-        case MOSFET:
-            printf("Type: MOSFET\n");
-            break;
-        case BJT:
-            printf("Type: BJT\n");
-            break;
-        default:
-            printf("Type: TBD");
-            break;
+// Settle detection: after a DAC change a channel counts as settled from the first window of its readings whose
+// mean agrees within settleTol LSB with the mean of the newest window, i.e. once it has stopped drifting over
+// the longest span the reads cover. At least half the reads must be left after that, so a slow drift has had
+// time to show. Reads before that are dropped, however many it takes. Fewer than 2 * SETTLE_WINDOW reads per
+// channel, as live mode takes, are split into two halves instead, the tolerance widened for their noisier means.
+#define SETTLE_WINDOW     4     // readings per window
+#define SETTLE_LSB        4.0   // default tolerance
+#define SETTLE_TIMEOUT_MS 50    // default timeout
+#define SETTLE_BUCKETS    10
+#define SETTLE_IDLE_US    500   // with several sockets, bus left to the others between settle reads
+double settleTol = SETTLE_LSB;
+double settleTimeout = SETTLE_TIMEOUT_MS;
+thread_local int settleRetry = BATCH_MAX_WORDS;     // reads per transfer while a part settles, live mode takes fewer
+const double settleEdge[SETTLE_BUCKETS] = {1, 2, 5, 10, 20, 50, 100, 1000, 10000, 1e12};  // bucket upper edges, us
+thread_local long settleTest[SETTLE_BUCKETS + 1];    // this test, the last bucket counts timeouts
+thread_local long settleClass[10][SETTLE_BUCKETS + 1];   // all tests, by subtype
+
+// First reply index in first..last-1 from which every channel in mask is settled, -1 if one never settles
+int settle_find(int first, int last, int mask){
+    int pos[BATCH_MAX_WORDS], val[BATCH_MAX_WORDS];
+    int n, found, settled = first, win;
+    double a, b, tol;
+
+    for(int ch = 0; ch < 8; ch++){
+        if(!(mask & (1 << ch))){
+            continue;
+        }
+        n = 0;
+        for(int i = first; i < last; i++){
+            if(batch_tag(i) == ch){
+                pos[n] = i; val[n++] = batch_code(i);
+            }
+        }
+
+        found = -1;
+        win = min(SETTLE_WINDOW, n / 2);
+        tol = settleTol * sqrt((double)SETTLE_WINDOW / max(win, 1));
+        if(win > 0){
+            a = 0; b = 0;
+            for(int w = 0; w < win; w++){
+                a += val[w];
+                b += val[n - win + w];
+            }
+            for(int j = 0; j <= n / 2 && j + 2 * win <= n; j++){
+                if(fabs(a - b) / win <= tol){
+                    found = pos[j];
+                    break;
+                }
+                a += val[j + win] - val[j];  // slide the early window
+            }
+        }
+        if(found < 0){
+            return -1;
+        }
+        settled = max(settled, found);
     }
-    switch(subtype){
-        case NMOS:
-            printf("Subtype: NMOS\n");
-            break;
-        case PMOS:
-            printf("Subtype: PMOS\n");
-            break;
-        case NPN:
-            printf("Subtype: NPN\n");
-            break;
-        case PNP:
-            printf("Subtype: PNP\n");
-            break;
-        default:
-            printf("Subtype: TBD\n");
-            break;
+    return settled;
+}
+
+// Mean of the oldest (newest = 0) or newest (newest = 1) window of each channel in mask among words first..last-1
+void settle_window(int first, int last, int mask, int newest, double mean[8]){
+    int n;
+
+    for(int ch = 0; ch < 8; ch++){
+        if(!(mask & (1 << ch))){
+            continue;
+        }
+        mean[ch] = 0; n = 0;
+        for(int k = 0; k < last - first && n < SETTLE_WINDOW; k++){
+            int i = newest ? last - 1 - k : first + k;
+            if(batch_tag(i) == ch){
+                mean[ch] += batch_code(i); n++;
+            }
+        }
+        mean[ch] /= max(n, 1);
     }
-    switch(one){ // terminal 1
-        case GATE:
-            printf("Terminal 1: GATE\n");
-            break;
-        case SOURCE:
-            printf("Terminal 1: SOURCE\n");
-            break;
-        case DRAIN:
-            printf("Terminal 1: DRAIN\n");
-            break;
-        case BASE:
-            printf("Terminal 1: BASE\n");
-            break;
-        case COLLECTOR:
-            printf("Terminal 1: COLLECTOR\n");
-            break;
-        case EMITTER:
-            printf("Terminal 1: EMITTER\n");
-            break;
-        default:
-            printf("Terminal 1: TBD\n");
-            break;
+}
+
+// Largest change of a channel in mask between the window means before and the oldest window of the batch
+double settle_drift(double before[8], int mask){
+    double now[8], drift = 0;
+
+    settle_window(0, batchWords, mask, 0, now);
+    for(int ch = 0; ch < 8; ch++){
+        if(mask & (1 << ch)){
+            drift = max(drift, fabs(now[ch] - before[ch]));
+        }
     }
-    switch(two){ // terminal 2
-        case GATE:
-            printf("Terminal 2: GATE\n");
-            break;
-        case SOURCE:
-            printf("Terminal 2: SOURCE\n");
-            break;
-        case DRAIN:
-            printf("Terminal 2: DRAIN\n");
-            break;
-        case BASE:
-            printf("Terminal 2: BASE\n");
-            break;
-        case COLLECTOR:
-            printf("Terminal 2: COLLECTOR\n");
-            break;
-        case EMITTER:
-            printf("Terminal 2: EMITTER\n");
-            break;
-        default:
-            printf("Terminal 2: TBD\n");
-            break;
+    return drift;
+}
+
+// Count one settle time in the histogram of this test, negative for a timeout
+void settle_log(double us){
+    int k = 0;
+
+    if(us < 0){
+        settleTest[SETTLE_BUCKETS]++;
+        return;
     }
-    switch(three){ // terminal 3
-        case GATE:
-            printf("Terminal 3: GATE\n");
-            break;
-        case SOURCE:
-            printf("Terminal 3: SOURCE\n");
-            break;
-        case DRAIN:
-            printf("Terminal 3: DRAIN\n");
-            break;
-        case BASE:
-            printf("Terminal 3: BASE\n");
-            break;
-        case COLLECTOR:
-            printf("Terminal 3: COLLECTOR\n");
-            break;
-        case EMITTER:
-            printf("Terminal 3: EMITTER\n");
-            break;
-        default:
-            printf("Terminal 3: TBD\n");
-            break;
+    while(k < SETTLE_BUCKETS - 1 && us >= settleEdge[k]){
+        k++;
     }
+    settleTest[k]++;
 }
-
-// Once MOSFET has been identified, differentiates the drain and source
-void drain_source(int nongate_a, int nongate_b, int gate, int subtype){
-    int m, tested;
-    tested = nongate_a;
-    int nongateIO = 0x10 << nongate_a;
-    int spiInCheck;
-    int cnt = 0;
-    int nongateRead, nongateReadSum, nongateHold;
-    int nongatecnt = 0;
 
-    // create new ADC sequence from nongate terminal number
-    int newADCSequence = (ADCSEQUENCE & 0b0001001000000000) | nongateIO;
+// Number of ADC channels in mask
+int adc_channels(int mask){
+    int n = 0;
 
-    // move proper voltages to gate and random non-gate terminal
-    volts[gate] = GROUNDED;
-    volts[nongate_a] = FIVE_VOLTS;
-    volts[nongate_b] = GROUNDED;
+    for(int ch = 0; ch < 8; ch++){
+        n += (mask >> ch) & 0x01;
+    }
+    return n;
+}
+
+// Write volts[] to the DACs, program the ADC sequence and collect reads samples in one transfer, then drop the
+// reads taken before the channels settled. A part still moving at the end is read settleRetry reads at a time
+// until it settles or settleTimeout runs out; with several sockets it first waits off the bus until it stops
+// moving. -1 if a transfer failed, res is then empty.
+int adc_measure(int sequence, int reads, adcBatch *res){
+    int first, settled;
+    double waited = 0, before[8];
+    struct timespec start, stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    batch_clear();
+    batch_dacs();
+    if(batch_sequence(sequence)){
+        batch_word(NOOP);   // no op command, garbage in
+    }
+    first = batchWords;
+    batch_noops(reads);
+    if(batch_send() < 0){
+        batch_demux(0, res);
+        return -1;
+    }
 
-    // write data to DACs
-    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    while((settled = settle_find(first, batchWords, sequence & 0x00FF)) < 0 && (waited + batchSeconds) * 1e3 < settleTimeout){
+        waited += batchSeconds;
+        if(socketCount > 1){
+            // leave the bus to the other sockets while this one settles, probing one window per channel
+            // until the readings move less than settleTol over an idle gap. One more gap takes the rest
+            // of that off, then all of the next batch counts.
+            do{
+                settle_window(first, batchWords, sequence & 0x00FF, 1, before);
+                usleep(SETTLE_IDLE_US);
+                batch_clear();
+                batch_noops(SETTLE_WINDOW * adc_channels(sequence & 0x00FF));
+                if(batch_send() < 0){
+                    batch_demux(0, res);
+                    return -1;
+                }
+                first = 0;
+                waited += SETTLE_IDLE_US / 1e6 + batchSeconds;
+            } while(settle_drift(before, sequence & 0x00FF) > settleTol && waited * 1e3 < settleTimeout);
+
+            usleep(SETTLE_IDLE_US);
+            waited += SETTLE_IDLE_US / 1e6;
+            batch_clear();
+            batch_noops(reads);
+            if(batch_send() < 0){
+                batch_demux(0, res);
+                return -1;
+            }
+            settled = (waited * 1e3 < settleTimeout) ? 0 : -1;
+            break;
+        }
+        batch_clear();
+        first = 0;
+        batch_noops(settleRetry);
+        if(batch_send() < 0){
+            batch_demux(0, res);
+            return -1;
+        }
+    }
 
-    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(settled < 0){
+        settle_log(-1);
+        settled = first;
+    }
+    else{
+        settle_log((waited + batchSeconds * settled / batchWords) * 1e6);
+    }
+    batch_demux(settled, res);
 
-    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(latRecording){
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        lat_add(&latSettle, (stop.tv_sec - start.tv_sec) * 1e6 + (stop.tv_nsec - start.tv_nsec) / 1e3);
+    }
+    return 0;
+}
 
-    spiOut[0] = newADCSequence >> 8;
-    spiOut[1] = newADCSequence & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Repeating ADC sequence over just the channels in mask
+int adc_sequence(int mask){
+    return (ADCSEQUENCE & 0b0001001000000000) | (mask & 0x00FF);
+}
 
-    makeWord(spiOut, 0b0000000000000000); //no op command, garbage in
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Sample scheduler: write volts[] to the DACs, sequence only the channels in mask and take exactly samples
+// conversions of each. The sequence runs round robin, so that is samples slots per channel and nothing discarded.
+int adc_sample(int mask, int samples, adcBatch *res){
+    int reads = samples * adc_channels(mask);
 
-    for(cnt = 0; cnt < 30; cnt++){
+    reads = min(reads, BATCH_MAX_WORDS - 5);   // DAC writes, sequence and pipeline word
+    return adc_measure(adc_sequence(mask), reads, res);
+}
 
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-        // read one of the non-gate terminals
-        if(spiInCheck == nongate_a + 4){
-            spiIn[0] = spiIn[0] & 0x0F;
-            nongateRead = spiIn[0]; // Place result into read-out array
-            nongateRead = (nongateRead << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-            nongateReadSum += nongateRead;
-            nongatecnt++;
+// Running mean and variance of one ADC channel (Welford)
+struct adcStat{
+    long n;
+    double mean;
+    double m2;
+};
+
+// Adaptive averaging settings and per-sweep bookkeeping
+double avgTarget = AVG_SE_LSB;
+int avgMin = AVG_MIN_SAMPLES;
+int avgMax = AVG_MAX_SAMPLES;
+FILE *avgLog = NULL;        // per-point sample counts, if requested
+thread_local long avgPoints = 0, avgTotal = 0;
+thread_local int avgFewest = 0, avgMost = 0;
+
+// Fold the reply words first..last-1 into the running statistics of the channels in mask
+void adc_welford(int first, int last, int mask, adcStat st[8]){
+    int ch;
+    double delta;
+
+    for(int i = first; i < last; i++){
+        ch = batch_tag(i);
+        if(!(mask & (1 << ch))){
+            continue;
         }
+        st[ch].n++;
+        delta = batch_code(i) - st[ch].mean;
+        st[ch].mean += delta / st[ch].n;
+        st[ch].m2 += delta * (batch_code(i) - st[ch].mean);
     }
+}
 
-    nongateHold = volts[nongate_a] - (nongateReadSum / nongatecnt);
-
-    // Move voltage around, reevaluate
-    // move proper voltages to gate and random non-gate terminal
-    volts[gate] = GROUNDED;
-    volts[nongate_b] = FIVE_VOLTS;
-    volts[nongate_a] = GROUNDED;
+// Samples per channel still needed before every channel in mask reaches the standard error target, 0 when done
+int adc_needed(int mask, adcStat st[8]){
+    int needed = 0;
+    long n;
+    double var;
 
-    // write data to DACs
-    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    for(int ch = 0; ch < 8; ch++){
+        if(!(mask & (1 << ch))){
+            continue;
+        }
+        n = st[ch].n;
+        var = (n > 1) ? st[ch].m2 / (n - 1) : 0;
+        if(var / n > avgTarget * avgTarget){
+            needed = max(needed, (int)(var / (avgTarget * avgTarget)) + 1 - (int)n);
+        }
+    }
+    return needed;
+}
 
-    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Fewest samples any channel in mask holds in res
+int adc_kept(int mask, adcBatch *res){
+    int kept = res->words;
 
-    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    for(int ch = 0; ch < 8; ch++){
+        if(mask & (1 << ch)){
+            kept = min(kept, res->cnt[ch]);
+        }
+    }
+    return kept;
+}
 
-    spiOut[0] = newADCSequence >> 8;
-    spiOut[1] = newADCSequence & 0x00FF;
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Averaging engine: take avgMin samples per channel, then keep sampling until the standard error of every
+// channel in mask reaches avgTarget or avgMax samples. Falls back to a fixed samples count when no target is set.
+// -1 if a transfer failed.
+int adc_average(int mask, int samples, adcBatch *res){
+    adcStat st[8];
+    adcBatch chunk;
+    int taken, needed, maxReads;
 
-    makeWord(spiOut, 0b0000000000000000); //no op command, garbage in
-    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    if(avgTarget <= 0){
+        return adc_sample(mask, samples, res);
+    }
 
-    nongateReadSum = 0;
-    nongatecnt = 0;
+    for(int ch = 0; ch < 8; ch++){
+        st[ch].n = 0; st[ch].mean = 0; st[ch].m2 = 0;
+    }
 
-    for(cnt = 0; cnt < 30; cnt++){
+    // first chunk writes the DACs and sequence, later chunks only clock out no-ops
+    if(adc_sample(mask, avgMin, res) < 0){
+        return -1;
+    }
+    adc_welford(batchWords - res->words, batchWords, mask, st);
+    taken = adc_kept(mask, res);     // settling may have dropped some of the avgMin
+
+    maxReads = (BATCH_MAX_WORDS / adc_channels(mask)) * adc_channels(mask);
+    while(taken < avgMax && (needed = adc_needed(mask, st)) > 0){
+        needed = min(needed, avgMax - taken);
+        batch_clear();
+        batch_noops(min(needed * adc_channels(mask), maxReads));
+        if(batch_send() < 0){
+            return -1;
+        }
+        batch_demux(0, &chunk);
+        adc_welford(0, batchWords, mask, st);
 
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-        spiInCheck = (spiIn[0] >> 4) & 0x07;
-        // printf("spiCheck: %d\n", spiInCheck);
-
-        // read the non-gate terminal again
-        if(spiInCheck == nongate_a + 4){
-            spiIn[0] = spiIn[0] & 0x0F;
-            nongateRead = spiIn[0]; // Place result into read-out array
-            nongateRead = (nongateRead << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-            nongateReadSum += nongateRead;
-            nongatecnt++;
-            //printf("ADC1: %d\n", ADC1read);
+        for(int ch = 0; ch < 8; ch++){
+            res->sum[ch] += chunk.sum[ch];
+            res->cnt[ch] += chunk.cnt[ch];
         }
-    }
-
-    // verify which terminals have been tested
-    if (abs(nongateHold) > abs(volts[nongate_a] - (nongateReadSum / nongatecnt))){
-        tested = nongate_a;
+        res->words += chunk.words;
+        taken = adc_kept(mask, res);
     }
-    else{
-        tested = nongate_b;
+
+    avgFewest = (avgPoints == 0) ? taken : min(avgFewest, taken);
+    avgMost = max(avgMost, taken);
+    avgTotal += taken;
+    avgPoints++;
+    return 0;
+}
+
+// Clear the scheduler statistics
+void adc_stats_reset(void){
+    for(int ch = 0; ch < 8; ch++){
+        adcSamples[ch] = 0;
+        adcSeconds[ch] = 0;
     }
-
-    // using body diode principle, identify the source/drain terminal
-    if(subtype == NMOS){
-        if(tested == nongate_a){
-            terminal_id[nongate_a] = SOURCE;
-            terminal_id[nongate_b] = DRAIN;
-        }
-        else if (tested == nongate_b){
-            terminal_id[nongate_b] = SOURCE;
-            terminal_id[nongate_a] = DRAIN;
+    shadowSent = 0;
+    shadowSkipped = 0;
+    avgPoints = 0;
+    avgTotal = 0;
+    avgFewest = 0;
+    avgMost = 0;
+}
+
+// Print samples taken and effective samples/second for each channel used since the last reset
+void adc_stats_report(const char *phase){
+    printf("%s ADC:", phase);
+    for(int ch = 4; ch < 7; ch++){
+        if(adcSamples[ch] > 0){
+            printf(" T%d %ld samples %.0f/s", ch - 3, adcSamples[ch], adcSamples[ch] / adcSeconds[ch]);
         }
     }
-    else if(subtype == PMOS){
-        if(tested == nongate_a){
-            terminal_id[nongate_b] = SOURCE;
-            terminal_id[nongate_a] = DRAIN;
-        }
-        else if (tested == nongate_b){
-            terminal_id[nongate_a] = SOURCE;
-            terminal_id[nongate_b] = DRAIN;
-        }
+    printf("\n%s register writes: %ld sent, %ld skipped\n", phase, shadowSent, shadowSkipped);
+    if(avgPoints > 0){
+        printf("%s samples/point: min %d, mean %.1f, max %d (target %.2f LSB)\n",
+               phase, avgFewest, (double)avgTotal / avgPoints, avgMost, avgTarget);
     }
 }
-
-// If device is found to not be a MOSFET, it is determined to be a BJT -- this function differentiates NPN from PNP
-int bjt_typer(/*int tone, int ttwo, int tthree*/){
-    int c1 = 0;
-    int cnt = 0;
-    int terminalCheck[3] = {0,0,0};
-    //terminalCheck[0] = 0; terminalCheck[1] = 0; terminalCheck[2] = 0;
-
-    int spiInCheck, ADC1read, ADC2read, ADC3read,
-    ADC1readSum = 0, ADC2readSum = 0, ADC3readSum = 0,
-    ADC1cnt = 0, ADC2cnt = 0, ADC3cnt = 0,
-    ADC1drop, ADC2drop, ADC3drop;
-    int cathodeIO, newADCSequence;
-
-    for(int i = 0; i < 3; i++){
-        volts[0] = GROUNDED; volts[1] = GROUNDED; volts[2] = GROUNDED;
-        volts[i] = ONE_VOLT;
-
-        // write data to DACs
-        spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-        spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-        spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-        spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
 
-        cathodeIO = 0x10 << i;
+// Fold this test's settle times into the histogram of its device class and print that histogram
+void settle_report(int subtype){
+    char str[][15] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP"};
+    long total = 0;
 
-        // create new ADC sequence from nongate terminal number
-        newADCSequence = (ADCSEQUENCE & 0b0001001000000000) | cathodeIO;
-
-        // Using just the ith ADC
-        spiOut[0] = newADCSequence >> 8;
-        spiOut[1] = newADCSequence & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        ADC1readSum = 0;
-        ADC1cnt = 0;
+    for(int k = 0; k <= SETTLE_BUCKETS; k++){
+        settleClass[subtype][k] += settleTest[k];
+        total += settleClass[subtype][k];
+        settleTest[k] = 0;
+    }
+    printf("Settle times, %s, %ld steps:", str[subtype], total);
+    for(int k = 0; k < SETTLE_BUCKETS; k++){
+        if(settleClass[subtype][k] > 0){
+            if(k < SETTLE_BUCKETS - 1){
+                printf(" <%.0fus %ld", settleEdge[k], settleClass[subtype][k]);
+            }
+            else{
+                printf(" >%.0fus %ld", settleEdge[k-1], settleClass[subtype][k]);
+            }
+        }
+    }
+    printf(" timeouts %ld\n", settleClass[subtype][SETTLE_BUCKETS]);
+}
 
-        // Take readings and averages
-        for(int ii = 0; ii < 30; ii++){
+// Time points sweep-sized batches through the selected backend
+void SPI_benchmark(int points){
+    struct timespec start, stop;
+    adcBatch adc;
+    double elapsed;
 
-            makeWord(spiOut, 0b0000000000000000); //no op command, data in
-            bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-            spiInCheck = (spiIn[0] >> 4) & 0x07;
-            // printf("spiCheck: %d\n", spiInCheck);
+    volts[0] = GROUNDED; volts[1] = GROUNDED; volts[2] = GROUNDED;
 
-            spiIn[0] = spiIn[0] & 0x0F;
-            ADC1read = spiIn[0]; // Place result into read-out array
-            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-            ADC1readSum += ADC1read;
-            ADC1cnt++;
-            // printf("ADC1: %d\n", ADC1read);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0; i < points; i++){
+        if(adc_sample(0b01010000, SWEEP_SAMPLES, &adc) < 0){
+            printf("SPI transfer failed after %d points.\n", i);
+            return;
         }
-        ADC1read = abs(ADC1readSum / ADC1cnt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
 
-        ADC1drop = abs(volts[i] - ADC1read);
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    const char *backend = spiBackend == SPI_SPIDEV ? spiDevice : dev->name;
 
-        if(ADC1drop > calVolts){
-            cnt++;
-            terminalCheck[i] = 1;
-        }
-//        printf("Volts: %d %d %d\n", volts[0], volts[1], volts[2]);
-//        printf("ADC: %d\n", ADC1read);
-//        printf("ADC drop: %d\n\n", ADC1drop);
+    printf("%s: %d points, %d words, %.3f s, %.1f us/point, %.0f words/s\n",
+           backend, points, points * batchWords,
+           elapsed, elapsed * 1e6 / points, points * batchWords / elapsed);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Identification Matrix
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// Every terminal read back over all DAC states in {0, 1 V, 5 V}^3, captured once per test. The classifiers below
+// only look states up, they never drive the DUT themselves.
+#define ID_LEVELS 3
+#define ID_STATES 27
+const int idLevel[ID_LEVELS] = {GROUNDED, ONE_VOLT, FIVE_VOLTS};
+thread_local int idSum[ID_STATES][3];        // all rounds
+thread_local int idCnt[ID_STATES][3];
+thread_local int idRoundSum[ID_STATES][3];   // last round only
+thread_local int idRoundCnt[ID_STATES][3];
+thread_local adcStat idStat[ID_STATES][8];   // indexed by ADC channel
+thread_local double idSeconds = 0;
+thread_local int idRounds = 0;
+
+// Sequential gate test settings
+double sprtAlpha = SPRT_ALPHA;
+double sprtEps = SPRT_EPS;
+thread_local int sprtLead = 0;               // vote lead volt_cycle stopped at
+
+// Matrix index of a set of terminal DAC codes
+int id_state(const int *v){
+    int s = 0;
+
+    for(int t = 0; t < 3; t++){
+        s = s * ID_LEVELS + (v[t] == FIVE_VOLTS ? 2 : (v[t] == ONE_VOLT ? 1 : 0));
     }
-    //cnt=2;
-    // printf("Count: %d\n", cnt);
-    if (cnt == 1){
-        //printf("IF 1");
-        for(int j = 0; j < 3; j++){
-            if(terminalCheck[j] == 1){
-                terminal_id[j] = BASE;
-            }
-        }
-        return NPN;
+    return s;
+}
+
+// DAC code minus the averaged ADC code of terminal t with the terminals driven to v
+int id_drop(const int *v, int t){
+    int s = id_state(v);
+
+    return v[t] - idSum[s][t] / max(1, idCnt[s][t]);
+}
+
+// Same, from the last round only
+int id_round_drop(const int *v, int t){
+    int s = id_state(v);
+
+    return v[t] - idRoundSum[s][t] / max(1, idRoundCnt[s][t]);
+}
+
+// Add the reads first..last-1 to matrix state s
+void id_add(int s, int first, int last){
+    int tag;
+
+    for(int i = first; i < last; i++){
+        tag = batch_tag(i);
+        if(tag >= 4 && tag < 7){
+            idSum[s][tag - 4] += batch_code(i);
+            idCnt[s][tag - 4]++;
+            idRoundSum[s][tag - 4] += batch_code(i);
+            idRoundCnt[s][tag - 4]++;
+        }
     }
-
-     else if (cnt == 2){
-        //terminalCheck[0] = 0; terminalCheck[1] = 1; terminalCheck[2] = 1;
-        //printf("Inside else if.\n");
-        for(int j = 0; j < 3; j++){
-            if(terminalCheck[j] != 1){
-                //printf("%d is the  base.\n", j);
-                terminal_id[j] = BASE;
+    adc_welford(first, last, 0b01110000, idStat[s]);
+}
 
+// Sort the settled reads of each state in the last transfer into the matrix. States that do not settle
+// within their reads are added to pending for a longer look.
+void id_collect(const int *states, const int *starts, const int *firsts, int n, int *pending, int *npending){
+    int settled;
+    double word = batchSeconds / batchWords;
 
-                //break;
+    for(int k = 0; k < n; k++){
+        int last = firsts[k] + 3 * ID_CELL_SAMPLES;
+        settled = settle_find(firsts[k], last, 0b01110000);
+        if(settled < 0){
+            pending[(*npending)++] = states[k];
+            continue;
+        }
+        settle_log((settled - starts[k]) * word * 1e6);
+        id_add(states[k], settled, last);
+    }
+}
+
+// Forget all rounds, at the start of each test
+void id_clear(void){
+    memset(idSum, 0, sizeof(idSum));
+    memset(idCnt, 0, sizeof(idCnt));
+    memset(idStat, 0, sizeof(idStat));
+    idSeconds = 0;
+    idRounds = 0;
+}
+
+// One round: walk all 27 states in a snake order so only one DAC changes between neighbours, packing as many
+// states into each transfer as fit. States slower than their slot are measured again on their own, reading until
+// they settle. Adds to the running matrix and replaces the last round, and stops at a failed transfer.
+void id_capture(void){
+    int reads = 3 * ID_CELL_SAMPLES;
+    int states[ID_STATES], starts[ID_STATES], firsts[ID_STATES];
+    int pending[ID_STATES], npending = 0;
+    int n = 0, row, col;
+    struct timespec start, stop;
+    adcBatch adc;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(idRoundSum, 0, sizeof(idRoundSum));
+    memset(idRoundCnt, 0, sizeof(idRoundCnt));
+
+    batch_clear();
+    if(batch_sequence(adc_sequence(0b01110000))){
+        batch_word(NOOP);   // garbage in
+    }
+    for(int a = 0; a < ID_LEVELS; a++){
+        for(int b = 0; b < ID_LEVELS; b++){
+            row = (a % 2) ? ID_LEVELS - 1 - b : b;
+            for(int c = 0; c < ID_LEVELS; c++){
+                col = ((a * ID_LEVELS + b) % 2) ? ID_LEVELS - 1 - c : c;
+                volts[0] = idLevel[a]; volts[1] = idLevel[row]; volts[2] = idLevel[col];
+
+                if(batchWords + 3 + reads > BATCH_MAX_WORDS){
+                    if(batch_send() < 0){
+                        return;
+                    }
+                    batch_demux(0, &adc);
+                    id_collect(states, starts, firsts, n, pending, &npending);
+                    batch_clear();
+                    n = 0;
+                }
+                starts[n] = batchWords;
+                batch_dacs();
+                states[n] = id_state(volts);
+                firsts[n++] = batchWords;
+                batch_noops(reads);
             }
-
         }
-        /*if(terminalCheck[2] == 0){
-            terminal_id[2] = BASE;
-        } else if(terminalCheck[1] == 0){
-            terminal_id[1] = BASE;
-        } else {
-            terminal_id[0] = BASE;
-        }*/
-        //printf("Right before return.");
-        return PNP;
     }
-
-    else{
-        return TBD;
+    if(batch_send() < 0){
+        return;
     }
-    //printf("Function dead.");
-}
+    batch_demux(0, &adc);
+    id_collect(states, starts, firsts, n, pending, &npending);
 
-// Once BJT is identified, identifies and reports the terminals using difference in beta between forward and reverse active cases
-void bjt_terminal_id(int subtype, int base){
+    for(int k = 0; k < npending; k++){
+        volts[0] = idLevel[pending[k] / 9]; volts[1] = idLevel[(pending[k] / 3) % 3]; volts[2] = idLevel[pending[k] % 3];
+        if(adc_measure(adc_sequence(0b01110000), reads, &adc) < 0){
+            return;
+        }
+        id_add(pending[k], batchWords - adc.words, batchWords);
+    }
 
-   // variables for data holds and math
-   int mbase, m, b1, b2, b0;
-   int newADCSequence, ADC1read, ADC1readSum, ADC1cnt;
-   int ADC2read, ADC2readSum, ADC2cnt;
-   int ADC3read, ADC3readSum, ADC3cnt;
-    int ADC1drop, ADC2drop, ADC3drop;
-    int spiInCheck;
-
-    switch(subtype){
-        case NPN:
-            switch(base){ // we know where the base is already, run through the different terminals
-                case 0:
-                   // iteration 1
-                   volts[0] = ONE_VOLT; volts[1] = FIVE_VOLTS; volts[2] = GROUNDED;
-
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001000110000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-                        // printf("spiCheck: %d\n", spiInCheck);
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                            //printf("ADC1: %d\n", ADC1read);
-                        }
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    // after reading ADC values, create a collector/base and emitter/base quotient (beta)
-                    ADC1drop = abs(volts[0] - ADC1read);
-                    ADC2drop = abs(volts[1] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b1 = m / (mbase+1);
-
-                   // iteration 2
-                   volts[0] = ONE_VOLT; volts[2] = FIVE_VOLTS; volts[1] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001010000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                        }
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    // after reading ADC values, create a collector/base and emitter/base quotient (beta)
-                    ADC1drop = abs(volts[0] - ADC1read);
-                    ADC2drop = abs(volts[2] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b2 = m / (mbase+1);
-
-                    if(b1 > b2){
-                        terminal_id[1] = COLLECTOR; terminal_id[2] = EMITTER;
-                    }
-                    else {
-                        terminal_id[2] = COLLECTOR; terminal_id[1] = EMITTER;
-                    }
-                    break;
-
-
-                case 1:
-                    // iteration 1
-                   volts[1] = ONE_VOLT; volts[0] = FIVE_VOLTS; volts[2] = GROUNDED;
-
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001000110000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                        }
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    // after reading ADC values, create a collector/base and emitter/base quotient (beta)
-                    ADC1drop = abs(volts[1] - ADC1read);
-                    ADC2drop = abs(volts[0] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b1 = m / (mbase+1);
-
-                   // iteration 2
-                   volts[1] = ONE_VOLT; volts[2] = FIVE_VOLTS; volts[0] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001100000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                        }
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[1] - ADC1read);
-                    ADC2drop = abs(volts[2] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b2 = m / (mbase+1);
-
-                    // the higher of the two beta values collected is the forward active case. The collector is at the highest bias
-                    if(b1 > b2){
-                        terminal_id[0] = COLLECTOR; terminal_id[2] = EMITTER;
-                    }
-                    else {
-                        terminal_id[2] = COLLECTOR; terminal_id[0] = EMITTER;
-                    }
-                    break;
-
-
-
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    idSeconds += (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    idRounds++;
+}
+
+// Quality of the capture: worst standard error of a cell, and how close the gate and base threshold tests
+// (drop against calVolts) came to flipping
+void id_report(void){
+    double se, worstSe = 0;
+    int margin = ADCMAX, v[3];
+
+    for(int s = 0; s < ID_STATES; s++){
+        for(int ch = 4; ch < 7; ch++){
+            if(idStat[s][ch].n > 1){
+                se = sqrt(idStat[s][ch].m2 / (idStat[s][ch].n - 1) / idStat[s][ch].n);
+                worstSe = max(worstSe, se);
+            }
+        }
+    }
+
+    v[0] = FIVE_VOLTS; v[1] = ONE_VOLT; v[2] = GROUNDED;
+    sort(v, v+3);
+    do{
+        for(int t = 0; t < 3; t++){
+            margin = min(margin, abs(abs(id_drop(v, t)) - calVolts));
+        }
+    } while(next_permutation(v, v+3));
+    for(int t = 0; t < 3; t++){
+        v[0] = GROUNDED; v[1] = GROUNDED; v[2] = GROUNDED;
+        v[t] = ONE_VOLT;
+        margin = min(margin, abs(abs(id_drop(v, t)) - calVolts));
+    }
+
+    printf("Identification matrix: %d states x %d reads, %d rounds (vote lead %d), %.1f ms, worst SE %.2f LSB, threshold margin %d LSB\n",
+           ID_STATES, 3 * ID_CELL_SAMPLES, idRounds, sprtLead, idSeconds * 1e3, worstSe, margin);
+}
+
+// Pull ground level for ADC from this function
+int AD5592_calibration(void){
 
-                case 2:
-                    // iteration 1
-                   volts[2] = ONE_VOLT; volts[1] = FIVE_VOLTS; volts[0] = GROUNDED;
+    // Set all voltages to ground
+    int calVoltage = GROUNDED;
+    int gndRead = 0;
+    int gndReadMax = 0;
+    int i = 0; // counter
+    int first;  // first read slot
+
+    // ground all DACs and read back in one transfer
+    volts[0] = calVoltage; volts[1] = calVoltage; volts[2] = calVoltage;
+    batch_clear();
+    batch_dacs();
+    first = batchWords;
+    batch_noops(90);
+    if(batch_send() < 0){
+        return 0;
+    }
+    first = max(first, settle_find(first, batchWords, ADCSEQUENCE & 0x00FF));
 
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    for(i = first; i < batchWords; i++){ // average ADC1 readings (30)
+            gndRead = batch_code(i); // Place result into read-out array
 
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001100000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                        }
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[2] - ADC1read);
-                    ADC2drop = abs(volts[1] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b1 = m / (mbase+1);
-
-                   // iteration 2
-                   volts[2] = ONE_VOLT; volts[0] = FIVE_VOLTS; volts[1] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001010000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                        }
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[2] - ADC1read);
-                    ADC2drop = abs(volts[0] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    b2 = m / (mbase+1);
-
-                    if(b1 > b2){
-                        terminal_id[1] = COLLECTOR; terminal_id[0] = EMITTER;
-                    }
-                    else {
-                        terminal_id[0] = COLLECTOR; terminal_id[1] = EMITTER;
-                    }
-                    break;
-                default:
-                    break;
+            // Grab maximum ground value
+            if (gndRead > gndReadMax){
+                gndReadMax = gndRead;
             }
-        break;
-
-
-/*----------------------------------------------------------------------------------------------------------------------------------------------------------------
-
-                                                            PNP Case
-
-----------------------------------------------------------------------------------------------------------------------------------------------------------------*/
-
-        case PNP:
-            int q1, q2, q3, q4;
-            switch(base){
-                case 0:
-                   // iteration 1
-                   volts[0] = GROUNDED; volts[1] = ONE_VOLT; volts[2] = GROUNDED;
-
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001000110000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-
-                        }
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[0] - ADC1read);
-                    ADC2drop = abs(volts[1] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    q1 = m / (mbase+1);
-
-
-                   // iteration 2
-                   volts[0] = GROUNDED; volts[2] = ONE_VOLT; volts[1] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001010000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-
-                        }
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[0] - ADC1read);
-                    ADC2drop = abs(volts[2] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    q2 = m / (mbase+1);
-
-                    //printf("beta: %d\n", q2);
-
-                    if(q1 > q2){
-                        terminal_id[2] = COLLECTOR; terminal_id[1] = EMITTER;
-                    }
-                    else {
-                        terminal_id[1] = COLLECTOR; terminal_id[2] = EMITTER;
-                    }
-                    break;
-
-
-
-
-                case 1:
-
-                    // iteration 1
-                   volts[1] = GROUNDED; volts[0] = ONE_VOLT; volts[2] = GROUNDED;
-
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001000110000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-
-                        if(spiInCheck == 5){ //was 5
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-
-                        }
-
-                        if(spiInCheck == 4){ //was 4
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-
-                        }
-
-                    }
-
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[1] - ADC1read);
-                    ADC2drop = abs(volts[0] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-
-                    q1 = m / (mbase+1); //MBASE WAS 0, CAUSING CRASH
-
-                   // iteration 2
-                   volts[1] = GROUNDED; volts[2] = ONE_VOLT; volts[0] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001100000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-
-                        }
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[1] - ADC1read);
-                    ADC2drop = abs(volts[2] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    q2 = m / (mbase+1);
-
-                    if(q1 > q2){
-                        terminal_id[0] = EMITTER; terminal_id[2] = COLLECTOR;
-                    }
-                    else {
-                        terminal_id[0] = COLLECTOR; terminal_id[2] = EMITTER;
-                    }
-                    break;
-
+        }
+
+    // return base ground level
+    return abs(gndReadMax);
+}
 
+// One round of the gate test on the last capture: the terminal (1-3) with no current in every voltage
+// permutation, or 0 if there is none
+int volt_vote(void){
+
+    // counters
+    int c1 = 0, c2 = 0, c3 = 0;
+
+    // voltages defined in globals, self-explanatory
+    volts[0] = FIVE_VOLTS;
+    volts[1] = ONE_VOLT;
+    volts[2] = GROUNDED;
 
+    sort(volts, volts+3);
 
-                case 2:
-                    // iteration 1
-                   volts[2] = GROUNDED; volts[1] = ONE_VOLT; volts[0] = GROUNDED;
+	do{
+        // increment counters based on voltage drops -- we're looking for a terminal with no current (i.e. gate)
+		if(abs(id_round_drop(volts, 0)) < calVolts){c1++;} //note some values will have to change based on number ranges recieved by ADC/DAC
 
-                    // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+		if(abs(id_round_drop(volts, 1)) < calVolts){c2++;}
 
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+		if(abs(id_round_drop(volts, 2)) < calVolts){c3++;}
+	} while (next_permutation(volts, volts+3)); // run through all possible voltage permutations
+
+    // is there a gate? if so, what terminal is it located on?
+    if( ((c1 == 6) || (c2 == 6) || (c3 == 6)) ){
+        if( (c1 > c2) && (c1 > c3) ){
+            return 1;
+        } else if( (c2 > c1) && (c2 > c3) ){
+            return 2;
+        } else if( (c3 > c1) && (c3 > c2) ){
+            return 3;
+        }
+    }
+    // if not, it's a BJT
+	return 0;
+}
 
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+// Cycles voltages to identify gate terminal (or lack thereof) on a MOSFET. Each round is one vote among
+// BJT/gate 1/2/3; if a round picks the wrong answer with probability sprtEps, spread over the other three, the
+// sequential test is done once the leading answer is ahead of the runner-up by enough votes to be wrong with
+// probability sprtAlpha. Ambiguous parts keep capturing rounds up to ID_MAX_ROUNDS, then the plurality wins.
+int volt_cycle(int tone, int ttwo, int tthree){
+    int votes[4] = {0, 0, 0, 0};
+    int need, best, second;
 
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001100000);
+    need = (int)ceil(log((1 - sprtAlpha) / sprtAlpha) / log((1 - sprtEps) * 3 / sprtEps));
+    need = max(1, need);
 
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+    while(1){
+        votes[volt_vote()]++;
 
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
+        best = 0;
+        for(int v = 1; v < 4; v++){
+            if(votes[v] > votes[best]){
+                best = v;
+            }
+        }
+        second = -1;
+        for(int v = 0; v < 4; v++){
+            if(v != best && (second < 0 || votes[v] > votes[second])){
+                second = v;
+            }
+        }
+        sprtLead = votes[best] - votes[second];
 
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
+        if(sprtLead >= need){
+            return best;
+        }
+        if(idRounds >= ID_MAX_ROUNDS || spiFailed){
+            return (sprtLead > 0) ? best : 0;
+        }
+        id_capture();
+    }
+}
+
+// If the device is a MOSFET, identifies PMOS vs. NMOS device
+int type_finder(int nongate, int gate){
 
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
+    int nongateReadBefore = 0, nongateReadAfter = 0;
+    int other = 3 - nongate - gate;
 
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-
-                        }
-
-                        if(spiInCheck == 5){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    ADC1drop = abs(volts[2] - ADC1read);
-                    ADC2drop = abs(volts[1] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    q1 = m / (mbase+1);
-
-                   // iteration 2
-                   volts[2] = GROUNDED; volts[0] = ONE_VOLT; volts[1] = GROUNDED;
-                   // write data to DACs
-                    spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-                    spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-                    spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-                    spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    // create new ADC sequence from 1V and 5V terminals
-                    newADCSequence = (ADCSEQUENCE & 0b0001001001010000);
-
-                    // Using just the base ADC
-                    spiOut[0] = newADCSequence >> 8;
-                    spiOut[1] = newADCSequence & 0x00FF;
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                    bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-                    ADC1readSum = 0; ADC2readSum = 0;
-                    ADC1cnt = 0; ADC2cnt = 0;
-
-                    // Take readings and averages
-                    for(int ii = 0; ii < 60; ii++){
-
-                        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-                        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-                        spiInCheck = (spiIn[0] >> 4) & 0x07;
-                        // printf("spiCheck: %d\n", spiInCheck);
-
-                        if(spiInCheck == 6){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC1read = spiIn[0]; // Place result into read-out array
-                            ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC1readSum += ADC1read;
-                            ADC1cnt++;
-                            //printf("ADC1: %d\n", ADC1read);
-                        }
-
-                        if(spiInCheck == 4){
-                            spiIn[0] = spiIn[0] & 0x0F;
-                            ADC2read = spiIn[0]; // Place result into read-out array
-                            ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                            ADC2readSum += ADC2read;
-                            ADC2cnt++;
-                        }
-
-                    }
-                    ADC1read = abs(ADC1readSum / ADC1cnt);
-                    ADC2read = abs(ADC2readSum / ADC2cnt);
-
-                    // after reading ADC values, create a collector/base and emitter/base quotient (beta)
-                    ADC1drop = abs(volts[2] - ADC1read);
-                    ADC2drop = abs(volts[0] - ADC2read);
-                    mbase = ADC1drop;
-                    m = ADC2drop;
-                    q2 = m / (mbase+1);
-
-                    if(q1 > q2){
-                        terminal_id[0] = COLLECTOR; terminal_id[1] = EMITTER;
-                    }
-                    else {
-                        terminal_id[1] = COLLECTOR; terminal_id[0] = EMITTER;
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
+    // 5V across the non-gate terminals both ways round, so the channel is on for one gate level whichever
+    // end is the source and the body diode conducts the same for both
+    for(int hi = 0; hi < 2; hi++){
+        volts[nongate] = hi ? FIVE_VOLTS : GROUNDED;
+        volts[other] = hi ? GROUNDED : FIVE_VOLTS;
 
+        // get before value (drop) of nongate terminal with the gate high
+        volts[gate] = FIVE_VOLTS;
+        nongateReadBefore += abs(id_drop(volts, nongate));
 
+        // ground the gate and check values again
+        volts[gate] = GROUNDED;
+        nongateReadAfter += abs(id_drop(volts, nongate));
+    }
+
+    // did the voltage increase or decrease?
+    // decrease ->
+    if (nongateReadBefore > nongateReadAfter){
+        return NMOS;
+    }
+    // increase ->
+    else if (nongateReadBefore < nongateReadAfter){
+        return PMOS;
+    }
+    else{
+        return TBD;
+    }
 
-            }
 }
-
-// Hard reset of the DAC/ADC
-void AD5592_reset(void){
 
-        // set the reset pin
-        bcm2835_gpio_fsel(RESET_PIN, BCM2835_GPIO_FSEL_OUTP);
-		bcm2835_gpio_set_pud(RESET_PIN, BCM2835_GPIO_PUD_UP);
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-        // drop and raise the reset pin level
-		bcm2835_gpio_clr(RESET_PIN);
-        delay(1);
-        bcm2835_gpio_set(RESET_PIN);
-        delay(1);
-
-        return;
-}
+                                                                Display Worker
 
-// Config data sent to DAC/ADC
-void AD5592_config(void){
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// The 7-segment readout runs on its own thread. Sev_seg_disp puts a message of glyphs and hold times together and
+// posts it, the worker steps through it while the sweep carries on. A preempting post cuts the message on screen
+// short, a looping message repeats until something else is posted.
+#define SEG_MAX_STEPS 32
+#define SEG_QUEUE     4
+
+struct segMessage{
+    int glyph[SEG_MAX_STEPS];
+    int hold[SEG_MAX_STEPS];    // ms to leave the glyph up
+    int steps;
+    int loop;
+};
+
+segMessage segQueue[SEG_QUEUE];
+int segHead = 0, segCount = 0;
+int segPreempt = 0;             // the message on screen should stop
+segMessage segBuild;            // message being put together
+pthread_t segThread;
+pthread_mutex_t segLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t segWake = PTHREAD_COND_INITIALIZER;
+
+void *seg_worker(void *arg){
+    segMessage msg;
+    struct timespec until;
+
+    rt_release();
+    pthread_mutex_lock(&segLock);
+    while(1){
+        while(segCount == 0){
+            pthread_cond_wait(&segWake, &segLock);
+        }
+        msg = segQueue[segHead];
+        segHead = (segHead + 1) % SEG_QUEUE;
+        segCount--;
+        segPreempt = 0;
+
+        do{
+            for(int k = 0; k < msg.steps && !segPreempt; k++){
+                pthread_mutex_unlock(&segLock);
+                dev->display(msg.glyph[k]);
+                pthread_mutex_lock(&segLock);
+
+                // hold the glyph, waking early only to be preempted
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_sec += msg.hold[k] / 1000;
+                until.tv_nsec += (msg.hold[k] % 1000) * 1000000L;
+                if(until.tv_nsec >= 1000000000L){
+                    until.tv_sec++;
+                    until.tv_nsec -= 1000000000L;
+                }
+                while(!segPreempt && pthread_cond_timedwait(&segWake, &segLock, &until) != ETIMEDOUT);
+            }
+        } while(msg.loop && !segPreempt && segCount == 0);
+    }
+    return NULL;
+}
+
+// Start the display worker
+int seg_start(void){
+    if(pthread_create(&segThread, NULL, seg_worker, NULL) != 0){
+        printf("Can't start the 7segment display worker.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Start a new message
+void seg_begin(void){
+    segBuild.steps = 0;
+}
+
+// Append a glyph to the message
+void seg_show(int glyph){
+    if(segBuild.steps < SEG_MAX_STEPS){
+        segBuild.glyph[segBuild.steps] = glyph;
+        segBuild.hold[segBuild.steps++] = 0;
+    }
+}
+
+// Leave the last glyph up for ms
+void seg_hold(int ms){
+    if(segBuild.steps > 0){
+        segBuild.hold[segBuild.steps - 1] += ms;
+    }
+}
+
+// Hand the message to the worker and return straight away. Preempting drops anything queued and cuts the message
+// on screen short, otherwise it waits its turn (the oldest queued message is dropped if the queue is full).
+void seg_post(int loop, int preempt){
+    segBuild.loop = loop;
+
+    pthread_mutex_lock(&segLock);
+    if(preempt){
+        segCount = 0;
+        segPreempt = 1;
+    }
+    else if(segCount == SEG_QUEUE){
+        segHead = (segHead + 1) % SEG_QUEUE;
+        segCount--;
+    }
+    segQueue[(segHead + segCount) % SEG_QUEUE] = segBuild;
+    segCount++;
+    pthread_cond_broadcast(&segWake);
+    pthread_mutex_unlock(&segLock);
+}
+
+// Appends the 7-segment readout of device type, subtype and terminals to the message being built
+void seg_result(int type, int sub, int t1, int t2, int t3){
+	switch(type){
+		case BJT:
+			seg_show(131); //letter b
+			seg_hold(SEGDELAY);
+			seg_show(225); //letter J
+			seg_hold(SEGDELAY);
+			seg_show(135); //letter T
+			seg_hold(SEGDELAY);
+			seg_show(127); //decimal
+			seg_hold(SEGDELAY);
+			switch(sub){
+				case NPN:
+					seg_show(171); //letter n
+					seg_hold(SEGDELAY);
+					seg_show(140); //letter P
+					seg_hold(SEGDELAY);
+					seg_show(171); //letter n
+					seg_hold(SEGDELAY);
+					seg_show(127); //decimal
+					seg_hold(SEGDELAY);
+					break;
+				case PNP:
+					seg_show(140); //letter P
+					seg_hold(SEGDELAY);
+					seg_show(171); //letter n
+					seg_hold(SEGDELAY);
+					seg_show(140); //letter P
+					seg_hold(SEGDELAY);
+					seg_show(127); //decimal
+					seg_hold(SEGDELAY);
+					break;
+				default:
+					seg_show(255); //display blank
+					break;
+			}
+			switch(t1){
+						case BASE:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(131); //letter b
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case COLLECTOR:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(198); //letter C
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case EMITTER:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(134); //letter E
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+					switch(t2){
+						case BASE:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(131); //letter b
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case COLLECTOR:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(198); //letter C
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case EMITTER:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(134); //letter E
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+					switch(t3){
+						case BASE:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(131); //letter b
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case COLLECTOR:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(198); //letter C
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case EMITTER:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(134); //letter E
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+			break;
+		case MOSFET:
+			seg_show(142); //letter F
+			seg_hold(SEGDELAY);
+			seg_show(134); //letter E
+			seg_hold(SEGDELAY);
+			seg_show(135); //letter T
+			seg_hold(SEGDELAY);
+			seg_show(127); //decimal
+			seg_hold(SEGDELAY);
+			switch(sub){
+				case NMOS:
+					seg_show(171); //letter n
+					seg_hold(SEGDELAY);
+					seg_show(127); //decimal
+					seg_hold(SEGDELAY);
+					break;
+				case PMOS:
+					seg_show(140); //letter P
+					seg_hold(SEGDELAY);
+					seg_show(127); //decimal
+					seg_hold(SEGDELAY);
+					break;
+				default:
+					seg_show(255); //display blank
+					break;
+			}
+			switch(t1){
+						case GATE:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(130); //letter G
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case DRAIN:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(161); //letter d
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case SOURCE:
+							seg_show(249); //number 1
+							seg_hold(SEGDELAY);
+							seg_show(146); //letter S
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+					switch(t2){
+						case GATE:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(130); //letter G
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case DRAIN:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(161); //letter d
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case SOURCE:
+							seg_show(164); //number 2
+							seg_hold(SEGDELAY);
+							seg_show(146); //letter S
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+					switch(t3){
+						case GATE:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(130); //letter G
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case DRAIN:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(161); //letter d
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						case SOURCE:
+							seg_show(176); //number 3
+							seg_hold(SEGDELAY);
+							seg_show(146); //letter S
+							seg_hold(SEGDELAY);
+							seg_show(127); //decimal
+							seg_hold(SEGDELAY);
+							break;
+						default:
+							seg_show(255); //display blank
+							break;
+					}
+			break;
+		default:
+			seg_show(255); //display blank
+			break;
+	}
+}
 
-	// Array containing 5592 configuration data declared above
-	int config[] =
-		{
-			ADCCONFIG,
-			DACCONFIG,
-			GPCONFIG,
-			GPIOCONFIG,
-			ADCSEQUENCE
-		};
+// Operates 7-segment LED after device type, subtype, and terminals have been identified.
+// Posts the readout to the display worker and returns; it keeps scrolling until the next result.
+void Sev_seg_disp(int type, int sub, int t1, int t2, int t3){
 
-		// counter variable
-		int j =  0;
+    printf("\nOutputting data to 7-segment display...\n");
+    seg_begin();
+    seg_result(type, sub, t1, t2, t3);
+    seg_post(1, 1);
+}
+
+// Displays component data to terminal
+int display_id(int one, int two, int three, int type, int subtype){
+    switch(type){
+        case MOSFET:
+            printf("Type: MOSFET\n");
+            break;
+        case BJT:
+            printf("Type: BJT\n");
+            break;
+        default:
+            printf("Type: TBD");
+            break;
+    }
+    switch(subtype){
+        case NMOS:
+            printf("Subtype: NMOS\n");
+            break;
+        case PMOS:
+            printf("Subtype: PMOS\n");
+            break;
+        case NPN:
+            printf("Subtype: NPN\n");
+            break;
+        case PNP:
+            printf("Subtype: PNP\n");
+            break;
+        default:
+            printf("Subtype: TBD\n");
+            break;
+    }
+    switch(one){ // terminal 1
+        case GATE:
+            printf("Terminal 1: GATE\n");
+            break;
+        case SOURCE:
+            printf("Terminal 1: SOURCE\n");
+            break;
+        case DRAIN:
+            printf("Terminal 1: DRAIN\n");
+            break;
+        case BASE:
+            printf("Terminal 1: BASE\n");
+            break;
+        case COLLECTOR:
+            printf("Terminal 1: COLLECTOR\n");
+            break;
+        case EMITTER:
+            printf("Terminal 1: EMITTER\n");
+            break;
+        default:
+            printf("Terminal 1: TBD\n");
+            break;
+    }
+    switch(two){ // terminal 2
+        case GATE:
+            printf("Terminal 2: GATE\n");
+            break;
+        case SOURCE:
+            printf("Terminal 2: SOURCE\n");
+            break;
+        case DRAIN:
+            printf("Terminal 2: DRAIN\n");
+            break;
+        case BASE:
+            printf("Terminal 2: BASE\n");
+            break;
+        case COLLECTOR:
+            printf("Terminal 2: COLLECTOR\n");
+            break;
+        case EMITTER:
+            printf("Terminal 2: EMITTER\n");
+            break;
+        default:
+            printf("Terminal 2: TBD\n");
+            break;
+    }
+    switch(three){ // terminal 3
+        case GATE:
+            printf("Terminal 3: GATE\n");
+            break;
+        case SOURCE:
+            printf("Terminal 3: SOURCE\n");
+            break;
+        case DRAIN:
+            printf("Terminal 3: DRAIN\n");
+            break;
+        case BASE:
+            printf("Terminal 3: BASE\n");
+            break;
+        case COLLECTOR:
+            printf("Terminal 3: COLLECTOR\n");
+            break;
+        case EMITTER:
+            printf("Terminal 3: EMITTER\n");
+            break;
+        default:
+            printf("Terminal 3: TBD\n");
+            break;
+    }
+    return 0;
+}
+
+// Once MOSFET has been identified, differentiates the drain and source
+void drain_source(int nongate_a, int nongate_b, int gate, int subtype){
+    int tested;
+    int nongateHold;
 
-		// Set number of elements in config array
-        int configIteration = sizeof(config)/sizeof(config[0]);
+    // move proper voltages to gate and random non-gate terminal, the gate turning the channel off so only
+    // the body diode conducts
+    volts[gate] = (subtype == PMOS) ? FIVE_VOLTS : GROUNDED;
+    volts[nongate_a] = FIVE_VOLTS;
+    volts[nongate_b] = GROUNDED;
 
-		// Transmit configuration data to 5592
-        for(j = 0; j < configIteration; j++)
-		{
-            spiOut[0] = config[j] >> 8;
-            spiOut[1] = config[j] & 0x00FF;
-			bcm2835_spi_transfern(spiOut, WORD_SIZE);
-		}
+    nongateHold = id_drop(volts, nongate_a);
 
-		return;
-}
-
-// initialize the SPI
-void SPI_init(void){
+    // Move voltage around, reevaluate
+    volts[nongate_b] = FIVE_VOLTS;
+    volts[nongate_a] = GROUNDED;
+
+    // verify which terminals have been tested
+    if (abs(nongateHold) > abs(id_drop(volts, nongate_a))){
+        tested = nongate_a;
+    }
+    else{
+        tested = nongate_b;
+    }
+
+    // using body diode principle, identify the source/drain terminal
+    if(subtype == NMOS){
+        if(tested == nongate_a){
+            terminal_id[nongate_a] = SOURCE;
+            terminal_id[nongate_b] = DRAIN;
+        }
+        else if (tested == nongate_b){
+            terminal_id[nongate_b] = SOURCE;
+            terminal_id[nongate_a] = DRAIN;
+        }
+    }
+    else if(subtype == PMOS){
+        if(tested == nongate_a){
+            terminal_id[nongate_b] = SOURCE;
+            terminal_id[nongate_a] = DRAIN;
+        }
+        else if (tested == nongate_b){
+            terminal_id[nongate_a] = SOURCE;
+            terminal_id[nongate_b] = DRAIN;
+        }
+    }
+}
+
+// If device is found to not be a MOSFET, it is determined to be a BJT -- this function differentiates NPN from PNP
+int bjt_typer(/*int tone, int ttwo, int tthree*/){
+    int cnt = 0;
+    int terminalCheck[3] = {0,0,0};
+
+    for(int i = 0; i < 3; i++){
+        volts[0] = GROUNDED; volts[1] = GROUNDED; volts[2] = GROUNDED;
+        volts[i] = ONE_VOLT;
+
+        // does the 1V terminal conduct into the grounded ones?
+        if(abs(id_drop(volts, i)) > calVolts){
+            cnt++;
+            terminalCheck[i] = 1;
+        }
+    }
+    //cnt=2;
+    // printf("Count: %d\n", cnt);
+    if (cnt == 1){
+        //printf("IF 1");
+        for(int j = 0; j < 3; j++){
+            if(terminalCheck[j] == 1){
+                terminal_id[j] = BASE;
+            }
+        }
+        return NPN;
+    }
+
+     else if (cnt == 2){
+        //terminalCheck[0] = 0; terminalCheck[1] = 1; terminalCheck[2] = 1;
+        //printf("Inside else if.\n");
+        for(int j = 0; j < 3; j++){
+            if(terminalCheck[j] != 1){
+                //printf("%d is the  base.\n", j);
+                terminal_id[j] = BASE;
+
+
+                //break;
+            }
+
+        }
+        /*if(terminalCheck[2] == 0){
+            terminal_id[2] = BASE;
+        } else if(terminalCheck[1] == 0){
+            terminal_id[1] = BASE;
+        } else {
+            terminal_id[0] = BASE;
+        }*/
+        //printf("Right before return.");
+        return PNP;
+    }
+
+    else{
+        return TBD;
+    }
+    //printf("Function dead.");
+}
+
+// Beta-like quotient of the biased terminal's current over the base current, the third terminal grounded
+int bjt_beta(int base, int biased, int other, int vbase, int vbiased){
+    volts[base] = vbase; volts[biased] = vbiased; volts[other] = GROUNDED;
+    return abs(id_drop(volts, biased)) / (abs(id_drop(volts, base)) + 1);
+}
+
+// Once BJT is identified, identifies and reports the terminals using difference in beta between forward and reverse active cases
+void bjt_terminal_id(int subtype, int base){
+
+    // the two other terminals, in the order they have always been tried
+    int first[3] = {1, 0, 1};
+    int second[3] = {2, 2, 0};
+    int x = first[base], y = second[base];
+    int b1, b2;
+
+    switch(subtype){
+        case NPN:
+            // base at 1V, each candidate in turn at 5V
+            b1 = bjt_beta(base, x, y, ONE_VOLT, FIVE_VOLTS);
+            b2 = bjt_beta(base, y, x, ONE_VOLT, FIVE_VOLTS);
+
+            // the higher of the two beta values collected is the forward active case. The collector is at the highest bias
+            if(b1 > b2){
+                terminal_id[x] = COLLECTOR; terminal_id[y] = EMITTER;
+            }
+            else {
+                terminal_id[y] = COLLECTOR; terminal_id[x] = EMITTER;
+            }
+            break;
+
+        case PNP:
+            // base grounded, each candidate in turn at 1V -- forward active puts the emitter at the bias
+            b1 = bjt_beta(base, x, y, GROUNDED, ONE_VOLT);
+            b2 = bjt_beta(base, y, x, GROUNDED, ONE_VOLT);
+
+            if(b1 > b2){
+                terminal_id[x] = EMITTER; terminal_id[y] = COLLECTOR;
+            }
+            else {
+                terminal_id[x] = COLLECTOR; terminal_id[y] = EMITTER;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Hard reset of the DAC/ADC. The reset line is shared by all sockets, so with several only this board gets
+// a software reset.
+void AD5592_reset(void){
+        if(socketCount > 1){
+            batch_clear();
+            batch_word(RESET);
+            batch_send();
+            dev->wait(1);
+        }
+        else{
+            dev->reset();
+        }
+        shadow_invalidate();
+        return;
+}
+
+// Config data sent to DAC/ADC
+void AD5592_config(void){
+
+	// Array containing 5592 configuration data declared above
+	int config[] =
+		{
+			ADCCONFIG,
+			DACCONFIG,
+			GPCONFIG,
+			GPIOCONFIG,
+			ADCSEQUENCE
+		};
+
+		// counter variable
+		int j =  0;
+
+		// Set number of elements in config array
+        int configIteration = sizeof(config)/sizeof(config[0]);
+
+		// Transmit configuration data to 5592
+        batch_clear();
+        for(j = 0; j < configIteration; j++)
+		{
+            batch_word(config[j]);
+		}
+        batch_send();
+        shadowSequence = ADCSEQUENCE;
+
+		return;
+}
+
+#ifndef AD5592_SIM
+// initialize the SPI
+void SPI_init(void){
 
         // Initialize SPI protocol
 		if(!bcm2835_init())return;
+		if(spiBackend == SPI_SPIDEV)return;    // kernel driver owns the SPI pins, bcm2835 only drives the GPIOs
 		bcm2835_spi_begin();
 		bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);    // MSB first
 		bcm2835_spi_setDataMode(BCM2835_SPI_MODE1);                 // Mode 1
@@ -1951,380 +2374,2898 @@ void SPI_init(void){
 
 		return;
 }
-
-// function generates the X values of the arrays for both the graph and the DAC input
-void voltage_ranger(){
-	// set the output curve tracer voltage range using samples and ADC maximum value (5V)
-	int i;
-	float step_size = VMAX / SAMPLESF;
-	float step_size_adc = ADCMAX / SAMPLESF;
-	for(i=0;i<=SAMPLES-1;i++){
-		volts_ct[i] = (i)*step_size;
-		volts_adc[i] = (i)*step_size_adc;
-	}
+#endif
+
+// open and configure the kernel spidev device, -1 on failure
+int spidev_init(const char *device){
+        unsigned char mode = SPI_MODE_1;
+        unsigned char bits = 8;
+        unsigned char lsbFirst = 0;
+        unsigned int speed = SPIDEV_SPEED;
+
+        spiFd = open(device, O_RDWR);
+        if(spiFd < 0){
+            perror(device);
+            return -1;
+        }
+        if(ioctl(spiFd, SPI_IOC_WR_MODE, &mode) < 0 ||
+           ioctl(spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+           ioctl(spiFd, SPI_IOC_WR_LSB_FIRST, &lsbFirst) < 0 ||
+           ioctl(spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0){
+            perror(device);
+            close(spiFd);
+            spiFd = -1;
+            return -1;
+        }
+        return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Devices
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+#ifndef AD5592_SIM
+int segFd = -1;     // I2C handle of the 7-segment display
+int buttonFd = -1;  // GPIO line event handle of the test button
+
+// Raspberry Pi: bcm2835 SPI and GPIO, wiringPi I2C display
+int pi_init(void){
+        // establish GPIO and I2C protocols
+        wiringPiSetup();
+        segFd = wiringPiI2CSetup(0x20);
+        if(segFd == -1){
+            printf("Can't setup the 7segment display.\n");
+            return -1;
+        }
+
+        // establish SPI protocols
+        SPI_init();
+
+        bcm2835_gpio_fsel(TEST_PIN, BCM2835_GPIO_FSEL_INPT);
+        bcm2835_gpio_set_pud(TEST_PIN, BCM2835_GPIO_PUD_UP);
+
+        // falling edges of the test button through the GPIO character device
+        struct gpioevent_request req;
+        int chip = open(BUTTON_CHIP, O_RDONLY);
+        if(chip >= 0){
+            memset(&req, 0, sizeof(req));
+            req.lineoffset = BUTTON_LINE;
+            req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+            req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+            snprintf(req.consumer_label, sizeof(req.consumer_label), "tracer button");
+            if(ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &req) == 0){
+                buttonFd = req.fd;
+                fcntl(buttonFd, F_SETFL, O_NONBLOCK);
+            }
+            close(chip);
+        }
+        if(buttonFd < 0){
+            printf("Can't watch the test button edges, polling its level instead.\n");
+        }
+        return 0;
+}
+
+void pi_reset(void){
+
+        // set the reset pin
+        bcm2835_gpio_fsel(RESET_PIN, BCM2835_GPIO_FSEL_OUTP);
+		bcm2835_gpio_set_pud(RESET_PIN, BCM2835_GPIO_PUD_UP);
+
+        // drop and raise the reset pin level
+		bcm2835_gpio_clr(RESET_PIN);
+        delay(1);
+        bcm2835_gpio_set(RESET_PIN);
+        delay(1);
+}
+
+int pi_button(void){
+        return bcm2835_gpio_lev(TEST_PIN);
 }
+
+int pi_edges(void){
+        return buttonFd;
+}
+
+void pi_display(int glyph){
+        wiringPiI2CWrite(segFd, glyph);
+}
+
+void pi_wait(unsigned int ms){
+        delay(ms);
+}
+
+tracerDevice piDevice = {"bcm2835", 1, pi_init, SPI_transfer_bcm2835, pi_reset, pi_button, pi_edges, pi_display, pi_wait};
+#endif
+
+// Simulated button: every simPress ms a 1 ms glitch, then a press that bounces before it holds down
+void *sim_presser(void *arg){
+        char edge = 0;
+
+        rt_release();
+        while(1){
+            usleep(simPress * 1000);
+            simLevel = 0;
+            write(simEdges[1], &edge, 1);
+            usleep(1000);
+            simLevel = 1;
+            usleep(100000);
+
+            for(int k = 0; k < SIM_BOUNCES; k++){
+                simLevel = 0;
+                write(simEdges[1], &edge, 1);
+                usleep(300);
+                simLevel = 1;
+                usleep(200);
+            }
+            simLevel = 0;
+            write(simEdges[1], &edge, 1);
+            usleep(SIM_HOLD_MS * 1000);
+            simLevel = 1;
+        }
+        return NULL;
+}
+
+// Simulated AD5592 and part, for host-side runs
+int sim_init(void){
+        pthread_t presser;
+
+        if(simPress > 0){
+            simLevel = 1;
+            if(pipe(simEdges) < 0){
+                perror("pipe");
+                return -1;
+            }
+            fcntl(simEdges[0], F_SETFL, O_NONBLOCK);
+            if(pthread_create(&presser, NULL, sim_presser, NULL) != 0){
+                printf("Can't start the simulated button.\n");
+                return -1;
+            }
+        }
+        return 0;
+}
+
+void sim_reset(void){
+        sim_power_on();
+}
+
+int sim_button(void){
+        return simLevel;    // held down unless --sim-press drives it
+}
+
+int sim_edges(void){
+        return simEdges[0];
+}
+
+void sim_display(int glyph){
+}
+
+void sim_wait(unsigned int ms){
+        usleep(ms * 1000);
+}
+
+tracerDevice simDevice = {"simulated AD5592", 0, sim_init, sim_AD5592_transfer, sim_reset, sim_button, sim_edges, sim_display, sim_wait};
+
+// Milliseconds since start
+double button_ms(struct timespec *start){
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Empty an edge fd
+void button_drain(int fd){
+        char buf[256];
+        while(read(fd, buf, sizeof(buf)) > 0)
+            ;
+}
+
+// Block until the test button is pressed: 1 pressed, 0 nothing within timeoutMs (0 waits forever), -1 error.
+// Sleeps in poll on the device's falling edges, a press counts if the button is still down buttonDebounce ms
+// after the edge. Devices without an edge source get their level polled every BUTTON_POLL_MS.
+int button_wait(int timeoutMs){
+        int fd = dev->edges();
+        struct pollfd pfd = {fd, POLLIN, 0};
+        struct timespec start, edge;
+        int left, r;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        buttonRejected = 0;
+
+        if(fd < 0){
+            while(dev->button() != 0){
+                if(timeoutMs > 0 && button_ms(&start) >= timeoutMs){
+                    return 0;
+                }
+                dev->wait(BUTTON_POLL_MS);
+            }
+            return 1;
+        }
+
+        button_drain(fd);   // presses during the last test don't start the next one
+        while(1){
+            left = -1;
+            if(timeoutMs > 0){
+                left = timeoutMs - (int)button_ms(&start);
+                if(left <= 0){
+                    return 0;
+                }
+            }
+            r = poll(&pfd, 1, left);
+            if(r < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                perror("poll");
+                return -1;
+            }
+            if(r == 0){
+                continue;
+            }
+
+            // let the contacts settle, swallowing their bounce edges
+            clock_gettime(CLOCK_MONOTONIC, &edge);
+            button_drain(fd);
+            while((left = buttonDebounce - (int)button_ms(&edge)) > 0){
+                if(poll(&pfd, 1, left) > 0){
+                    button_drain(fd);
+                }
+            }
+            if(dev->button() == 0){
+                return 1;
+            }
+            buttonRejected++;
+        }
+}
+
+// Place part ("nmos", "pmos", "npn", "pnp" or "open") in the simulated socket, pins gives the roles of terminals 1..3 (e.g. "SGD", "EBC"), -1 if they don't match
+int sim_socket(const char *part, const char *pins){
+        const char *names[] = {"open", "nmos", "pmos", "npn", "pnp"};
+        int parts[] = {TBD, NMOS, PMOS, NPN, PNP};
+        const char *letters = (strcmp(part, "npn") == 0 || strcmp(part, "pnp") == 0) ? "BCE" : "GSD";
+        int p, k;
+
+        for(p = 0; p < 5 && strcmp(part, names[p]) != 0; p++)
+            ;
+        if(p == 5){
+            return -1;
+        }
+        simPart = parts[p];
+        if(simPart == TBD){
+            return 0;
+        }
+
+        if(pins == NULL){
+            pins = (letters[0] == 'B') ? "EBC" : "SGD";
+        }
+        if(strlen(pins) != 3){
+            return -1;
+        }
+        for(k = 0; k < 3; k++){
+            const char *at = strchr(letters, pins[k]);
+            if(at == NULL || strchr(pins + k + 1, pins[k]) != NULL){
+                return -1;
+            }
+            simRole[k] = (letters[0] == 'B') ? BASE + (at - letters) : GATE + (at - letters);
+        }
+        return 0;
+}
+
+// 1 if nothing but blanks is left of a setting
+int spec_rest(const char *text){
+    return text[strspn(text, " \t\r\n")] == '\0';
+}
+
+// parse a comma separated list of distinct curve steps, returns the count or -1. A repeated step would run
+// into the curve before it in the CSV, where curves are told apart by their gate/base value.
+int spec_list(const char *text, float *steps){
+    int n = 0;
+    char *end;
+
+    while(n < MAX_CURVES){
+        steps[n++] = strtof(text, &end);
+        if(end == text || steps[n-1] < 0 || steps[n-1] > VMAX){
+            return -1;
+        }
+        for(int k = 0; k < n - 1; k++){
+            if(steps[k] == steps[n-1]){
+                return -1;
+            }
+        }
+        while(*end == ' ' || *end == '\t'){
+            end++;
+        }
+        if(*end != ','){
+            return spec_rest(end) ? n : -1;
+        }
+        text = end + 1;
+    }
+    return -1;
+}
+
+// load a preset by name, or a file of key = value lines (points, span, gates, bases; # starts a comment)
+int spec_load(const char *source){
+    FILE *fp;
+    char line[256], key[32], *end;
+    int pos, n, ok;
+    float steps[MAX_CURVES];
+
+    for(unsigned int p = 0; p < sizeof(sweepPresets) / sizeof(sweepPresets[0]); p++){
+        if(strcmp(source, sweepPresets[p].name) == 0){
+            spec = sweepPresets[p];
+            return 0;
+        }
+    }
+
+    fp = fopen(source, "r");
+    if(fp == NULL){
+        perror(source);
+        return -1;
+    }
+    spec.name = source;
+    while(fgets(line, sizeof(line), fp) != NULL){
+        line[strcspn(line, "#\n")] = '\0';
+        if(spec_rest(line)){
+            continue;
+        }
+        pos = -1;
+        sscanf(line, " %31[a-z] = %n", key, &pos);
+        ok = (pos >= 0);
+        if(ok && strcmp(key, "points") == 0){
+            spec.points = strtol(line + pos, &end, 10);
+            ok = (end != line + pos && spec_rest(end));
+        }
+        else if(ok && strcmp(key, "span") == 0){
+            spec.span = strtof(line + pos, &end);
+            ok = (end != line + pos && spec_rest(end));
+        }
+        else if(ok && (strcmp(key, "gates") == 0 || strcmp(key, "bases") == 0)){
+            n = spec_list(line + pos, steps);
+            ok = (n > 0);
+            if(ok && key[0] == 'g'){
+                spec.mosCurves = n; memcpy(spec.mos, steps, sizeof(steps));
+            }
+            else if(ok){
+                spec.bjtCurves = n; memcpy(spec.bjt, steps, sizeof(steps));
+            }
+        }
+        else{
+            ok = 0;
+        }
+        if(!ok){
+            printf("%s: bad sweep setting %s\n", source, line);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// size the sweep buffers from the spec, once at startup. A progressive sweep keeps every curve's raw codes at
+// once, a row each, plus a row to pack previews in.
+int sweep_alloc(){
+    int rows = progressive ? MAX_CURVES + 1 : 1;
+
+    if(spec.points < 2 || spec.points > MAX_POINTS || spec.span <= 0 || spec.span > VMAX){
+        printf("Sweep %s: need 2-%d points and a span of 0-%.2f V.\n", spec.name, MAX_POINTS, VMAX);
+        return -1;
+    }
+    volts_ct = (double *)malloc(spec.points * sizeof(double));
+    volts_adc = (int *)malloc(spec.points * sizeof(int));
+    curr = (double *)malloc(spec.points * sizeof(double));
+    voltsVDS = (double *)malloc(spec.points * sizeof(double));
+    measured = (char *)malloc(spec.points);
+    measuredIdx = (int *)malloc(spec.points * sizeof(int));
+    probeVDS = (double *)malloc(spec.points * sizeof(double));
+    probeCurr = (double *)malloc(spec.points * sizeof(double));
+    received = (char *)malloc(rows * spec.points);
+    raw.point = (uint16_t *)malloc(5 * rows * spec.points * sizeof(uint16_t));
+    raw.src = raw.point + rows * spec.points;
+    raw.drn = raw.src + rows * spec.points;
+    raw.dac = raw.drn + rows * spec.points;
+    raw.samples = raw.dac + rows * spec.points;
+    plotBuf = (double *)malloc(2 * min(max(spec.mosCurves, spec.bjtCurves), PLOT_MAX_CURVES) * spec.points * sizeof(double));
+    if(volts_ct == NULL || volts_adc == NULL || curr == NULL || voltsVDS == NULL || measured == NULL || measuredIdx == NULL ||
+       probeVDS == NULL || probeCurr == NULL || received == NULL || raw.point == NULL || plotBuf == NULL){
+        printf("Sweep %s: out of memory for %d points.\n", spec.name, spec.points);
+        return -1;
+    }
+    return 0;
+}
+
+// number of curves and gate/base voltage of curve k for the device under test
+int sweep_curves(int type){
+    return (type == BJT) ? spec.bjtCurves : spec.mosCurves;
+}
+
+float sweep_gate(int subtype, int k){
+    switch(subtype){
+        case NMOS: return spec.mos[k];
+        case PMOS: return VMAX - spec.mos[k];    // Runs Vgs in reverse for plot
+        case NPN: return spec.bjt[k];
+        case PNP: return VMAX - spec.bjt[k];
+        default: return 0;
+    }
+}
+
+// function generates the X values of the arrays for both the graph and the DAC input
+void voltage_ranger(){
+	// set the output curve tracer voltage range using the sweep points and span
+	int i;
+	float step_size = spec.span / spec.points;
+	float step_size_adc = ADCMAX * (spec.span / VMAX) / spec.points;
+	for(i=0;i<=spec.points-1;i++){
+		volts_ct[i] = (i)*step_size;
+		volts_adc[i] = (i)*step_size_adc;
+	}
+}
+
+// output curve k of the trace data to file
+void print_csv(int k, float vgs, int type, int subtype){
+    FILE *ofp;
+
+    // char outputFilename[] = "curve.csv";
+
+    // set when to write and when to append file
+	if( k == 0 ){
+        ofp = fopen(fname, "w"); // write
+        trace_csv_header(ofp, type, subtype, terminal_id);
+    }
+    else{
+        ofp = fopen(fname, "a"); // append
+    }
+    trace_csv_points(ofp, vgs, voltsVDS, curr, curvePoints);
+	fclose(ofp);
+}
+
+// header of this sweep's trace, also what the CSV conversion of its codes reads
+void trace_header(traceHeader *h, int type, int subtype){
+    memset(h, 0, sizeof(*h));
+    h->magic = TRACE_MAGIC;
+    h->version = TRACE_VERSION;
+    h->headerSize = sizeof(*h);
+    h->type = type; h->subtype = subtype;
+    h->terminal[0] = terminal_id[0]; h->terminal[1] = terminal_id[1]; h->terminal[2] = terminal_id[2];
+    h->points = spec.points;
+    h->span = spec.span;
+    h->steps = min(sweep_curves(type), TRACE_STEPS);
+    for(int k = 0; k < h->steps; k++){
+        h->step[k] = sweep_gate(subtype, k);
+    }
+    h->calVolts = calVolts;
+    h->adcMax = ADCMAX;
+    h->vMax = VMAX;
+    h->resistor = RESISTOR;
+    h->encoding = TRACE_CODES;
+    h->trim = spec.points / 50;     // 10 points at the full 500 point sweep
+}
+
+// output the curve's codes to the binary trace: the header with the first curve, then a block per curve
+void print_trace(int k, float vgs, traceHeader *h){
+    FILE *ofp;
+    traceCurve c = {vgs, (uint32_t)curvePoints};
+    size_t packed = trace_packed(curvePoints), size = trace_block(TRACE_CODES, curvePoints) - sizeof(c);
+    uint8_t *block = (uint8_t *)calloc(size, 1);
+
+	if( k == 0 ){
+        h->curves = 0;
+        ofp = fopen(fname, "wb");
+    }
+    else{
+        ofp = fopen(fname, "r+b");
+    }
+    if(ofp == NULL || block == NULL){
+        perror(fname);
+        if(ofp != NULL){
+            fclose(ofp);
+        }
+        free(block);
+        return;
+    }
+    trace_pack(block, raw.point, curvePoints);
+    trace_pack(block + packed, raw.src, curvePoints);
+    trace_pack(block + 2 * packed, raw.drn, curvePoints);
+    trace_pack(block + 3 * packed, raw.dac, curvePoints);
+    memcpy(block + ((4 * packed + 1) & ~(size_t)1), raw.samples, curvePoints * sizeof(uint16_t));
+    h->curves++;
+    fwrite(h, sizeof(*h), 1, ofp);
+    fseek(ofp, 0, SEEK_END);
+    fwrite(&c, sizeof(c), 1, ofp);
+    fwrite(block, size, 1, ofp);
+    fclose(ofp);
+    free(block);
+}
+
+// convert a trace to the curve CSV next to it (name.trc -> name.csv), csv gets the name when given
+int trace_convert(const char *trc, char *csv){
+    traceFile t;
+    char name[1000];
+    FILE *ofp;
+    int n = strlen(trc), ok;
+
+    if(trace_open(trc, &t) < 0){
+        printf("%s: not a curve trace.\n", trc);
+        return -1;
+    }
+    if(n > 4 && strcmp(trc + n - 4, ".trc") == 0){
+        n -= 4;
+    }
+    snprintf(name, sizeof(name), "%.*s.csv", n, trc);
+    ofp = fopen(name, "w");
+    if(ofp == NULL){
+        perror(name);
+        trace_close(&t);
+        return -1;
+    }
+    ok = trace_csv(&t, ofp);
+    fclose(ofp);
+    trace_close(&t);
+    if(ok < 0){
+        printf("%s: cut short, converted the complete curves.\n", trc);
+    }
+    if(csv != NULL){
+        strcpy(csv, name);
+    }
+    return ok;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Sweep Pipeline
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// The thread driving the SPI bus only measures: each sweep point goes into a lock-free single producer/single
+// consumer ring as the raw codes it was taken with, and a processing thread converts, trims and writes the curves.
+// A full ring holds the producer back (a stall), an empty one parks the consumer; both poll every RING_WAIT_US.
+#define SWEEP_RING   1024   // records, power of two
+#define RING_WAIT_US 100
+
+#define REC_POINT 0     // a measured point
+#define REC_CURVE 1     // the curve at vgs is complete
+#define REC_END   2     // the sweep is complete
+#define REC_PASS  3     // a progressive pass is complete
+
+struct sweepRecord{
+    uint8_t kind;
+    uint8_t src, drn;   // terminals read as source/emitter and drain/collector
+    uint8_t curve;      // index of the curve, progressive sweeps interleave them
+    uint16_t point;     // index into the sweep grid, or the step of a finished pass
+    uint16_t dac[3];    // DAC codes on terminals 1..3
+    uint16_t cnt[2];    // ADC samples of src and drn
+    float vgs;          // gate/base voltage of the curve
+    int32_t sum[2];     // ADC code sums of src and drn
+};
+
+struct sweepRing{
+    sweepRecord buf[SWEEP_RING];
+    std::atomic<unsigned> head;     // written by the producer only
+    std::atomic<unsigned> tail;     // written by the consumer only
+    int records, high, stalls;
+    double stallMs;
+};
+
+thread_local sweepRing ring;            // this socket's, handed to its processing thread
+thread_local sweepRecord pointRec;      // point adcdac_returnExt just measured
+
+// empty the ring and its statistics, with no consumer running
+void ring_clear(sweepRing *rg){
+    rg->head.store(0);
+    rg->tail.store(0);
+    rg->records = 0; rg->high = 0; rg->stalls = 0; rg->stallMs = 0;
+}
+
+// producer side: queue a record, waiting while the ring is full
+void ring_push(sweepRing *rg, const sweepRecord *r){
+    unsigned head = rg->head.load(std::memory_order_relaxed);
+    struct timespec t0, t1;
+
+    if(head - rg->tail.load(std::memory_order_acquire) == SWEEP_RING){
+        rg->stalls++;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        while(head - rg->tail.load(std::memory_order_acquire) == SWEEP_RING){
+            usleep(RING_WAIT_US);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        rg->stallMs += (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    }
+    rg->buf[head & (SWEEP_RING - 1)] = *r;
+    rg->head.store(head + 1, std::memory_order_release);
+
+    rg->records++;
+    rg->high = max(rg->high, (int)(head + 1 - rg->tail.load(std::memory_order_relaxed)));
+}
+
+// consumer side: take the oldest record, waiting while the ring is empty
+void ring_pop(sweepRing *rg, sweepRecord *r){
+    unsigned tail = rg->tail.load(std::memory_order_relaxed);
+
+    while(rg->head.load(std::memory_order_acquire) == tail){
+        usleep(RING_WAIT_US);
+    }
+    *r = rg->buf[tail & (SWEEP_RING - 1)];
+    rg->tail.store(tail + 1, std::memory_order_release);
+}
+
+void ring_report(sweepRing *rg){
+    printf("Sweep ring: %d records, high water %d of %d, %d stalls (%.1f ms)\n", rg->records, rg->high, SWEEP_RING, rg->stalls, rg->stallMs);
+}
+
+// VDS/VCE and drain/collector current of a measured point
+void sweep_convert(const sweepRecord *r, int subtype, double *vds, double *i){
+    int ADC1read = r->sum[0] / r->cnt[0];
+    int ADC2read = r->sum[1] / r->cnt[1];
+    int drop = r->dac[r->drn] - ADC2read;
+
+    if (subtype == PNP || subtype == PMOS){
+        *vds = (ADC1read - ADC2read);
+    }
+    else{
+        *vds = (ADC2read - ADC1read);
+    }
+    *vds = (*vds / ADCMAX) * VMAX;
+
+    *i = (double)(drop) / (float)(ADCMAX) * (float)(VMAX) / float(RESISTOR);
+    if (subtype == PNP || subtype == PMOS){ // if the device is a PMOS or PNP, change the current to negative to flip the axis
+        *i = -*i;
+    }
+}
+
+// what the processing thread needs to know about the part, and the measuring thread's ring and curve buffers
+struct sweepJob{
+    int type, subtype;
+    sweepRing *ring;
+    double *vds, *i;
+    rawCurve raw;
+    plotFigure *figure;
+    double *plotBuf;
+    char *received;
+    const char *fname;
+    int id[3];
+    int cal;            // calVolts of the socket, for the trace header
+    tracerSocket *socket;
+};
+
+void plot_preview(plotFigure *f, int type, int subtype);    // Plotting, below
+
+// progressive sweeps: a preview of every curve with the points received so far, packed in the spare row
+void sweep_preview(sweepJob *job, traceHeader *h, int step, struct timespec *start){
+    int n = min(sweep_curves(job->type), PLOT_MAX_CURVES), row, count, most = 0;
+    uint16_t *point = raw.point + MAX_CURVES * spec.points, *src = raw.src + MAX_CURVES * spec.points;
+    uint16_t *drn = raw.drn + MAX_CURVES * spec.points, *dac = raw.dac + MAX_CURVES * spec.points;
+    struct timespec now;
+
+    for(int k = 0; k < n; k++){
+        plotCurve *c = &job->figure->curve[k];
+        double *x = job->plotBuf + 2 * k * spec.points;
+
+        count = 0;
+        for(int i = 0; i < spec.points; i++){
+            row = k * spec.points + i;
+            if(received[row]){
+                point[count] = i;
+                src[count] = raw.src[row]; drn[count] = raw.drn[row]; dac[count] = raw.dac[row];
+                count++;
+            }
+        }
+        trace_codes_values(h, count, point, src, drn, dac, x, x + spec.points);
+        c->gate = sweep_gate(job->subtype, k);
+        c->count = count;
+        c->x = x;
+        c->y = x + spec.points;
+        most = max(most, count);
+    }
+    job->figure->curves = n;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Preview 1/%d of %s: %d curves x %d points, %.0f ms into the sweep\n", step, fname, n, most,
+           (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6);
+    plot_preview(job->figure, job->type, job->subtype);
+    job->figure->curves = 0;
+}
+
+// processing thread: convert the points of each curve as they arrive, then trim, pack and write the curve
+void *sweep_processor(void *arg){
+    sweepJob *job = (sweepJob *)arg;
+    sweepRecord r;
+    traceHeader header;
+    struct timespec start;
+    int i, row;
+
+    rt_release();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // curve buffers and file of the socket that started us
+    voltsVDS = job->vds;
+    curr = job->i;
+    raw = job->raw;
+    received = job->received;
+    snprintf(fname, sizeof(fname), "%s", job->fname);
+    terminal_id[0] = job->id[0]; terminal_id[1] = job->id[1]; terminal_id[2] = job->id[2];
+    calVolts = job->cal;
+    sock = job->socket;
+    trace_header(&header, job->type, job->subtype);
+    job->figure->curves = 0;
+
+    memset(received, 0, (progressive ? MAX_CURVES : 1) * spec.points);
+    while(1){
+        ring_pop(job->ring, &r);
+        if(r.kind == REC_END){
+            break;
+        }
+        if(r.kind == REC_POINT){
+            row = (progressive ? r.curve * spec.points : 0) + r.point;
+            raw.src[row] = r.sum[0] / r.cnt[0];
+            raw.drn[row] = r.sum[1] / r.cnt[1];
+            raw.dac[row] = r.dac[r.drn];
+            raw.samples[row] = r.cnt[1];
+            received[row] = 1;
+            if(avgLog != NULL){
+                fprintf(avgLog, "%f,%d,%d\n", r.vgs, r.point, r.cnt[1]);
+            }
+            continue;
+        }
+        if(r.kind == REC_PASS){
+            sweep_preview(job, &header, r.point, &start);
+            continue;
+        }
+
+        // a progressive sweep finishes the curves in order once they are all measured; the earlier ones are
+        // written already, so the curve's row moves to the first
+        if(progressive && r.curve > 0){
+            row = r.curve * spec.points;
+            memcpy(raw.src, raw.src + row, spec.points * sizeof(uint16_t));
+            memcpy(raw.drn, raw.drn + row, spec.points * sizeof(uint16_t));
+            memcpy(raw.dac, raw.dac + row, spec.points * sizeof(uint16_t));
+            memcpy(raw.samples, raw.samples + row, spec.points * sizeof(uint16_t));
+            memcpy(received, received + row, spec.points);
+        }
+
+        // pack the received points to the front
+        curvePoints = 0;
+        for(i=0;i<=spec.points-1;i++){
+            if(received[i]){
+                raw.point[curvePoints] = i;
+                raw.src[curvePoints] = raw.src[i];
+                raw.drn[curvePoints] = raw.drn[i];
+                raw.dac[curvePoints] = raw.dac[i];
+                raw.samples[curvePoints] = raw.samples[i];
+                curvePoints++;
+            }
+        }
+        if(adaptive){
+            printf("Curve %.2f: %d points\n", r.vgs, curvePoints);
+        }
+
+        // keep the curve's values for the plot
+        if((plotMode == PLOT_NATIVE || plotMode == PLOT_WORKER) && job->figure->curves < PLOT_MAX_CURVES){
+            plotCurve *c = &job->figure->curve[job->figure->curves];
+            double *x = job->plotBuf + 2 * job->figure->curves * spec.points;
+            trace_codes_values(&header, curvePoints, raw.point, raw.src, raw.drn, raw.dac, x, x + spec.points);
+            c->gate = r.vgs;
+            c->count = curvePoints;
+            c->x = x;
+            c->y = x + spec.points;
+            job->figure->curves++;
+        }
+
+        if(traceOut){
+            print_trace(r.curve, r.vgs, &header);
+        }
+        else{
+            // volts and amps only now, with the first points of P curves trimmed (ADC noise)
+            trace_codes_values(&header, curvePoints, raw.point, raw.src, raw.drn, raw.dac, voltsVDS, curr);
+            print_csv(r.curve, r.vgs, job->type, job->subtype);
+        }
+        memset(received, 0, spec.points);
+    }
+    return NULL;
+}
+
+// extension of adcdac_return function
+void adcdac_returnExt(int gateBase, int srcEmitter, int drainCollector, int* ADC1drop, int subtype){
+
+        adcBatch adc;
+
+        // write out to DACs and sample only the source and drain of device until the average is good enough,
+        // transfer sweeps read the gate/base too
+        if(adc_average((0x10 << srcEmitter) | (0x10 << drainCollector) | (sweepReadGate ? 0x10 << gateBase : 0), sweepSamples, &adc) < 0){
+            *ADC1drop = 0;      // spiFailed is set, callers drop the point
+            return;
+        }
+        if(sweepReadGate){
+            gateRead = adc.sum[gateBase + 4] / adc.cnt[gateBase + 4];
+            gateTerminal = gateBase;
+        }
+
+        // keep the raw readings, the processing thread converts them
+        pointRec.dac[0] = volts[0]; pointRec.dac[1] = volts[1]; pointRec.dac[2] = volts[2];
+        pointRec.src = srcEmitter; pointRec.drn = drainCollector;
+        pointRec.sum[0] = adc.sum[srcEmitter + 4]; pointRec.cnt[0] = adc.cnt[srcEmitter + 4];
+        pointRec.sum[1] = adc.sum[drainCollector + 4]; pointRec.cnt[1] = adc.cnt[drainCollector + 4];
+        *ADC1drop = volts[drainCollector] - pointRec.sum[1] / pointRec.cnt[1];
+}
+
+// adcdac_return function grabs the current values from the device for the curve trace and outputs it to the curve trace file function
+int adcdac_return(int vds, float vgs, int t1, int t2, int t3, int subtype){
+
+    int ADC1drop, ADC2drop;
+
+    if( (subtype == NMOS) || (subtype == NPN) ){    // NMOS/NPN first
+
+        // run through each possible iteration and output required curve trace test voltages to device under test
+        if( (t1 == GATE) || (t1 == BASE) ){
+            if( (t2 == SOURCE) || (t2 == EMITTER) ){
+                volts[0] = (vgs*ADCMAX)/VMAX; volts[1] = GROUNDED; volts[2] = vds; // set proper output voltages
+                adcdac_returnExt(0, 1, 2, &ADC1drop, subtype); // send them to the extension function
+                return ADC1drop; // return the drop
+            }
+            else {
+                volts[0] = (vgs*ADCMAX)/VMAX; volts[2] = GROUNDED; volts[1] = vds;
+                adcdac_returnExt(0, 2, 1, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+        }
+
+        else if( (t2 == GATE) || (t2 == BASE) ){
+            if( (t1 == SOURCE) || (t1 == EMITTER) ){
+                volts[0] = GROUNDED; volts[1] = (vgs*ADCMAX)/VMAX; volts[2] = vds;
+                adcdac_returnExt(1, 0, 2, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+            else{
+                volts[2] = GROUNDED; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = vds;
+                adcdac_returnExt(1, 2, 0, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+        }
+
+        else if( (t1 == SOURCE) || (t1 == EMITTER) ){
+            volts[0] = GROUNDED; volts[1] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
+            adcdac_returnExt(2, 0, 1, &ADC1drop, subtype);
+            return ADC1drop;
+        }
+        else{
+                volts[1] = GROUNDED; volts[0] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
+                adcdac_returnExt(2, 1, 0, &ADC1drop, subtype);
+                return ADC1drop;
+        }
+    }
+
+    if( (subtype == PMOS) || (subtype == PNP) ){ // PMOS/PNP next
+
+        if( (t1 == GATE) || (t1 == BASE) ){
+            if( (t2 == DRAIN) || (t2 == COLLECTOR) ){
+                volts[0] = (vgs*ADCMAX)/VMAX; volts[2] = FIVE_VOLTS; volts[1] = vds;
+                adcdac_returnExt(0, 2, 1, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+            else {
+                volts[0] = (vgs*ADCMAX)/VMAX; volts[1] = FIVE_VOLTS; volts[2] = vds;
+                adcdac_returnExt(0, 1, 2, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+        }
+
+        else if( (t2 == GATE) || (t2 == BASE) ){
+            if( (t1 == DRAIN) || (t1 == COLLECTOR) ){
+                volts[2] = FIVE_VOLTS; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = vds;
+                adcdac_returnExt(1, 2, 0, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+            else{
+                volts[2] = vds; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = FIVE_VOLTS;
+                adcdac_returnExt(1, 0, 2, &ADC1drop, subtype);
+                return ADC1drop;
+            }
+        }
+
+        else if ( (t3 == GATE) || (t3 == BASE)){
+        if( (t1 == DRAIN) || (t1 == COLLECTOR) ){
+            volts[1] = FIVE_VOLTS; volts[0] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
+            adcdac_returnExt(2, 1, 0, &ADC1drop, subtype);
+            return ADC1drop;
+        }
+        else{
+            volts[0] = FIVE_VOLTS; volts[1] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
+            adcdac_returnExt(2, 0, 1, &ADC1drop, subtype);
+            return ADC1drop;
+        }
+        }
+    }
+    return 0;
+}
+
+// measure point i of the current curve and hand it to the processing thread, the adaptive grid also
+// needs it converted into probeVDS[i] and probeCurr[i]
+void sweep_point(int i, int subtype, int t1, int t2, int t3){
+    adcdac_return(volts_adc[i], vgsCorrected, t1, t2, t3, subtype);
+    if(spiFailed){
+        return;
+    }
+    pointRec.kind = REC_POINT;
+    pointRec.point = i;
+    pointRec.vgs = vgsCorrected;
+    if(adaptive){
+        sweep_convert(&pointRec, subtype, &probeVDS[i], &probeCurr[i]);
+    }
+    ring_push(&ring, &pointRec);
+}
+
+// distance of point m from the chord between points a and b, as a fraction of full scale on either axis
+double sweep_deviation(int a, int m, int b){
+    double t = (double)(m - a) / (b - a);
+    double dv = probeVDS[m] - (probeVDS[a] + t * (probeVDS[b] - probeVDS[a]));
+    double di = probeCurr[m] - (probeCurr[a] + t * (probeCurr[b] - probeCurr[a]));
+
+    return max(fabs(dv) / VMAX, fabs(di) / (VMAX / RESISTOR));
+}
+
+// measure a coarse grid, then keep splitting the interval next to the most bent point until
+// every point lies within adaptTol of the chord of its neighbours or adaptBudget points are taken
+void sweep_adaptive(int subtype, int t1, int t2, int t3){
+    int *idx = measuredIdx;
+    int n = 0, cnt, worst, m;
+    int coarse = max(1, spec.points / ADAPT_COARSE);
+    double err, worstErr;
+
+    memset(measured, 0, spec.points);
+    for(int i = 0; i < spec.points; i += coarse){
+        sweep_point(i, subtype, t1, t2, t3);
+        measured[i] = 1; n++;
+    }
+    if(!measured[spec.points-1]){
+        sweep_point(spec.points-1, subtype, t1, t2, t3);
+        measured[spec.points-1] = 1; n++;
+    }
+
+    while(n < adaptBudget){
+        cnt = 0;
+        for(int i = 0; i < spec.points; i++){
+            if(measured[i]){
+                idx[cnt++] = i;
+            }
+        }
+
+        // an interval is as bad as the bend at either of its ends
+        worst = -1; worstErr = adaptTol;
+        for(int j = 0; j < cnt - 1; j++){
+            if(idx[j+1] - idx[j] < 2){
+                continue;
+            }
+            err = 0;
+            if(j > 0){
+                err = sweep_deviation(idx[j-1], idx[j], idx[j+1]);
+            }
+            if(j + 2 < cnt){
+                err = max(err, sweep_deviation(idx[j], idx[j+1], idx[j+2]));
+            }
+            if(err > worstErr){
+                worstErr = err; worst = j;
+            }
+        }
+        if(worst < 0){
+            break;
+        }
+
+        m = (idx[worst] + idx[worst+1]) / 2;
+        sweep_point(m, subtype, t1, t2, t3);
+        measured[m] = 1; n++;
+    }
+}
+
+// measure every curve a pass at a time: every PROGRESSIVE_STEP-th point and the last one, then the points halfway
+// between those measured, until the step is 1. Each point is measured once, the same grid as a plain sweep.
+void sweep_progressive(int type, int subtype, int t1, int t2, int t3){
+    sweepRecord pass;
+
+    for(int step = PROGRESSIVE_STEP; step >= 1; step /= 2){
+        for(int k = 0; k < sweep_curves(type); k++){
+            vgsCorrected = sweep_gate(subtype, k);
+            pointRec.curve = k;
+            for(int i = 0; i < spec.points; i++){
+                if(step == PROGRESSIVE_STEP ? (i % step == 0 || i == spec.points - 1) : (i % step == 0 && i % (2 * step) != 0 && i != spec.points - 1)){
+                    sweep_point(i, subtype, t1, t2, t3);
+                }
+            }
+        }
+        pass.kind = REC_PASS;
+        pass.point = step;
+        ring_push(&ring, &pass);
+    }
+}
+
+// evaluates the current range of the device, measuring here while sweep_processor writes the curves
+void current_ranger(int type, int subtype,int t1,int t2, int t3){
+	int i,k;
+	sweepJob job = {type, subtype, &ring, voltsVDS, curr, raw, &figure, plotBuf, received, fname, {terminal_id[0], terminal_id[1], terminal_id[2]}, calVolts, sock};
+	sweepRecord done;
+	pthread_t processor;
+
+	ring_clear(&ring);
+	if(pthread_create(&processor, NULL, sweep_processor, &job) != 0){
+        printf("Can't start the sweep processing thread.\n");
+        return;
+	}
+
+	lat_start();
+	if(progressive){
+        sweep_progressive(type, subtype, t1, t2, t3);
+	}
+	for(k=0;k<sweep_curves(type);k++){
+        vgsCorrected = sweep_gate(subtype, k);
+        pointRec.curve = k;
+
+        if(adaptive){
+            sweep_adaptive(subtype, t1, t2, t3);
+        }
+        else if(!progressive){
+            for(i=0;i<=spec.points-1;i++){
+                sweep_point(i, subtype, t1, t2, t3);
+            }
+        }
+
+        done.kind = REC_CURVE;
+        done.curve = k;
+        done.vgs = vgsCorrected;
+        ring_push(&ring, &done);
+    }
+    done.kind = REC_END;
+    ring_push(&ring, &done);
+    lat_report();
+    pthread_join(processor, NULL);
+    ring_report(&ring);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Live Mode
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// --live fps turns the tracer into a classic curve tracer: once the part is identified the family of curves is swept
+// over and over on a reduced grid, and every finished frame goes to a viewer thread, drawn in the terminal or sent
+// to the clients of --live-socket, until the test button is pressed again. Frames are double buffered: the sweep
+// fills one while the viewer shows the other, and only waits for the viewer when it is still busy at the swap.
+// After each frame the sweep scales its work, points per curve times samples per point, to fit the frame period:
+// below LIVE_POINTS points it gives up points and averages LIVE_MIN_SAMPLES, above it first raises the averaging to
+// SWEEP_SAMPLES, then the points up to the sweep spec's. A sweep that fits with room to spare waits out the period.
+#define LIVE_MIN_POINTS  16
+#define LIVE_POINTS      100    // points per curve before averaging goes up
+#define LIVE_MIN_SAMPLES 4
+#define LIVE_SETTLE_READS 32   // reads per transfer while a point settles
+#define LIVE_HEADROOM    0.9    // of the frame period, left for the viewer and jitter
+#define LIVE_SHORTFALL   0.95   // of the target rate, below which the run is reported as missing it
+#define LIVE_CLIENTS     4
+#define LIVE_COLS        72     // terminal plot
+#define LIVE_ROWS        20
+
+double liveFps = 0;             // frame rate target, 0 = one-shot sweeps
+const char *liveSocket = NULL;  // stream frames to this Unix socket instead of the terminal
+int liveFrames = 0;             // stop after this many frames, 0 = at the next button press
+
+struct liveFrame{
+    int seq, curves, points, samples;
+    double seconds;             // sweep time
+    float gate[MAX_CURVES];
+    double *vds, *i;            // curve k at k * spec.points
+};
+
+liveFrame live[2];
+int liveFront = -1;             // frame the viewer may show
+int liveSeq = 0, liveBusy = 0, liveQuit = 0;
+int liveWaits = 0;              // swaps that had to wait for the viewer
+double liveWaitMs = 0;
+pthread_mutex_t liveLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t liveReady = PTHREAD_COND_INITIALIZER;
+pthread_cond_t liveIdle = PTHREAD_COND_INITIALIZER;
+char *liveText = NULL;          // a rendered frame
+size_t liveTextSize;
+int liveFd = -1, liveClient[LIVE_CLIENTS];
+const char *liveAxes[3];        // gate, x and y names for the running part
+
+// append to liveText, dropping what doesn't fit
+void live_print(size_t *n, const char *format, ...){
+    va_list args;
+
+    va_start(args, format);
+    if(*n < liveTextSize){
+        *n += vsnprintf(liveText + *n, liveTextSize - *n, format, args);
+    }
+    va_end(args);
+    *n = min(*n, liveTextSize - 1);
+}
+
+// the frame as characters: one symbol per curve, current up, VDS/VCE across
+size_t live_terminal(const liveFrame *f, double fps){
+    char grid[LIVE_ROWS][LIVE_COLS + 1];
+    double lo = 0, hi = 0;
+    size_t n = 0;
+    int row, col;
+
+    for(int k = 0; k < f->curves; k++){
+        for(int p = 0; p < f->points; p++){
+            lo = min(lo, f->i[k * spec.points + p]);
+            hi = max(hi, f->i[k * spec.points + p]);
+        }
+    }
+    if(hi - lo < 1e-6){
+        hi = lo + 1e-6;
+    }
+    memset(grid, ' ', sizeof(grid));
+    for(int k = 0; k < f->curves; k++){
+        for(int p = 0; p < f->points; p++){
+            col = (int)(f->vds[k * spec.points + p] / PLOT_XMAX * (LIVE_COLS - 1) + 0.5);
+            row = (int)((hi - f->i[k * spec.points + p]) / (hi - lo) * (LIVE_ROWS - 1) + 0.5);
+            if(col >= 0 && col < LIVE_COLS && row >= 0 && row < LIVE_ROWS){
+                grid[row][col] = "0123456789ABCDEF"[k];
+            }
+        }
+    }
+
+    if(isatty(STDOUT_FILENO)){
+        live_print(&n, "\033[H\033[J");
+    }
+    live_print(&n, "Frame %d: %d curves x %d points, %d samples, sweep %.1f ms, %.1f fps\n",
+               f->seq, f->curves, f->points, f->samples, f->seconds * 1000, fps);
+    for(row = 0; row < LIVE_ROWS; row++){
+        grid[row][LIVE_COLS] = 0;
+        if(row == 0 || row == LIVE_ROWS - 1){
+            live_print(&n, "%8.3f |%s\n", (row == 0 ? hi : lo) * 1e3, grid[row]);
+        }
+        else{
+            live_print(&n, "%8s |%s\n", row == 1 ? liveAxes[2] : (row == 2 ? "mA" : ""), grid[row]);
+        }
+    }
+    live_print(&n, "%8s +", "");
+    for(col = 0; col < LIVE_COLS; col++){
+        live_print(&n, "-");
+    }
+    live_print(&n, "\n%8s  0%*s%*.2f V\n", "", LIVE_COLS / 2, liveAxes[1], LIVE_COLS / 2 - 3, PLOT_XMAX);
+    for(int k = 0; k < f->curves; k++){
+        live_print(&n, "%s%c: %s = %.1f", k == 0 ? "   " : "  ", "0123456789ABCDEF"[k], liveAxes[0], f->gate[k]);
+    }
+    live_print(&n, "\n");
+    return n;
+}
+
+// the frame as text lines for the socket clients: "frame seq curves points samples ms", then per curve
+// "curve gate count" and count "vds,current" lines, then "end"
+size_t live_lines(const liveFrame *f){
+    size_t n = 0;
+
+    live_print(&n, "frame %d %d %d %d %.3f\n", f->seq, f->curves, f->points, f->samples, f->seconds * 1000);
+    for(int k = 0; k < f->curves; k++){
+        live_print(&n, "curve %.2f %d\n", f->gate[k], f->points);
+        for(int p = 0; p < f->points; p++){
+            live_print(&n, "%.4f,%.6e\n", f->vds[k * spec.points + p], f->i[k * spec.points + p]);
+        }
+    }
+    live_print(&n, "end\n");
+    return n;
+}
+
+// send a frame to every client, dropping the ones that can't keep up
+void live_send(size_t n){
+    int fd;
+
+    while(liveFd >= 0 && (fd = accept(liveFd, NULL, NULL)) >= 0){
+        int k;
+        for(k = 0; k < LIVE_CLIENTS && liveClient[k] >= 0; k++)
+            ;
+        if(k == LIVE_CLIENTS){
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        liveClient[k] = fd;
+        printf("Live: viewer %d connected\n", k + 1);
+    }
+    for(int k = 0; k < LIVE_CLIENTS; k++){
+        if(liveClient[k] >= 0 && send(liveClient[k], liveText, n, MSG_NOSIGNAL) != (ssize_t)n){
+            printf("Live: viewer %d dropped\n", k + 1);
+            close(liveClient[k]);
+            liveClient[k] = -1;
+        }
+    }
+}
+
+// viewer thread: show each new front frame
+void *live_viewer(void *arg){
+    struct timespec start, now;
+    liveFrame *f;
+    int seen = 0, shown = 0;
+    double fps = 0, sec;
+    size_t n;
+
+    rt_release();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(1){
+        pthread_mutex_lock(&liveLock);
+        while(liveSeq == seen && !liveQuit){
+            pthread_cond_wait(&liveReady, &liveLock);
+        }
+        if(liveSeq == seen){
+            pthread_mutex_unlock(&liveLock);
+            break;
+        }
+        seen = liveSeq;
+        f = &live[liveFront];
+        liveBusy = 1;
+        pthread_mutex_unlock(&liveLock);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        sec = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+        fps = (shown++ > 0 && sec > 0) ? (shown - 1) / sec : 0;
+        if(liveSocket != NULL){
+            live_send(live_lines(f));
+        }
+        else{
+            n = live_terminal(f, fps);
+            fwrite(liveText, 1, n, stdout);
+            fflush(stdout);
+        }
+
+        pthread_mutex_lock(&liveLock);
+        liveBusy = 0;
+        pthread_cond_signal(&liveIdle);
+        pthread_mutex_unlock(&liveLock);
+    }
+    return NULL;
+}
+
+// frame buffers, text buffer and the viewer socket, once at startup
+int live_start(void){
+    struct sockaddr_un addr;
+
+    if(liveFps <= 0){
+        return 0;
+    }
+    for(int b = 0; b < 2; b++){
+        live[b].vds = (double *)malloc(2 * MAX_CURVES * spec.points * sizeof(double));
+        live[b].i = live[b].vds + MAX_CURVES * spec.points;
+    }
+    liveTextSize = MAX_CURVES * (spec.points + 1) * 32 + (LIVE_ROWS + 8) * (LIVE_COLS + 32);
+    liveText = (char *)malloc(liveTextSize);
+    if(live[0].vds == NULL || live[1].vds == NULL || liveText == NULL){
+        printf("Live: out of memory for %d points.\n", spec.points);
+        return -1;
+    }
+    for(int k = 0; k < LIVE_CLIENTS; k++){
+        liveClient[k] = -1;
+    }
+    if(liveSocket == NULL){
+        return 0;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(liveSocket) >= sizeof(addr.sun_path)){
+        printf("Live socket path too long.\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, liveSocket);
+    unlink(liveSocket);
+    liveFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(liveFd < 0 || bind(liveFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(liveFd, LIVE_CLIENTS) < 0){
+        perror(liveSocket);
+        return -1;
+    }
+    fcntl(liveFd, F_SETFL, O_NONBLOCK);
+    printf("Live frames on %s\n", liveSocket);
+    return 0;
+}
+
+// a new press of the test button since the last call, without waiting for one
+int live_pressed(int *level){
+    int fd = dev->edges(), now;
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    if(fd >= 0){
+        if(poll(&pfd, 1, 0) <= 0){
+            return 0;
+        }
+        button_drain(fd);
+        dev->wait(buttonDebounce);
+        return dev->button() == 0;
+    }
+    now = dev->button();
+    if(now == *level){
+        return 0;
+    }
+    *level = now;
+    return now == 0;
+}
+
+// sweep the curves of the identified part on the live grid until the button is pressed again
+void live_run(int type, int subtype, int t1, int t2, int t3){
+    struct timespec start, t0, swept, now;
+    pthread_t viewer;
+    double budget = LIVE_HEADROOM / liveFps, period = 1 / liveFps, work, sec;
+    double savedTarget = avgTarget;
+    int back = 0, frames = 0, points = LIVE_MIN_POINTS, level = dev->button(), p, i;
+    liveFrame *f;
+
+    liveAxes[0] = (type == BJT) ? "VB" : "VG";
+    liveAxes[1] = (type == BJT) ? "VCE" : "VDS";
+    liveAxes[2] = (type == BJT) ? "IC" : "ID";
+    liveSeq = 0; liveFront = -1; liveBusy = 0; liveQuit = 0; liveWaits = 0; liveWaitMs = 0;
+    if(pthread_create(&viewer, NULL, live_viewer, NULL) != 0){
+        printf("Can't start the live viewer.\n");
+        return;
+    }
+
+    avgTarget = 0;              // live frames average a fixed count
+    sweepSamples = LIVE_MIN_SAMPLES;
+    settleRetry = LIVE_SETTLE_READS;
+    printf("Live: %.1f fps target, press the test button to stop\n", liveFps);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(liveFrames == 0 || frames < liveFrames){
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        f = &live[back];
+        f->curves = sweep_curves(type);
+        f->points = points;
+        f->samples = sweepSamples;
+        for(int k = 0; k < f->curves; k++){
+            vgsCorrected = sweep_gate(subtype, k);
+            f->gate[k] = vgsCorrected;
+            for(p = 0; p < points; p++){
+                i = p * (spec.points - 1) / (points - 1);
+                adcdac_return(volts_adc[i], vgsCorrected, t1, t2, t3, subtype);
+                if(spiFailed){
+                    break;
+                }
+                sweep_convert(&pointRec, subtype, &f->vds[k * spec.points + p], &f->i[k * spec.points + p]);
+            }
+        }
+        if(spiFailed){
+            printf("Live: SPI transfer failed, stopping.\n");
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &swept);
+        f->seconds = (swept.tv_sec - t0.tv_sec) + (swept.tv_nsec - t0.tv_nsec) / 1e9;
+        f->seq = ++frames;
+
+        // swap, once the viewer is done with the front frame
+        pthread_mutex_lock(&liveLock);
+        if(liveBusy){
+            liveWaits++;
+            while(liveBusy){
+                pthread_cond_wait(&liveIdle, &liveLock);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            liveWaitMs += (now.tv_sec - swept.tv_sec) * 1e3 + (now.tv_nsec - swept.tv_nsec) / 1e6;
+        }
+        liveFront = back;
+        liveSeq++;
+        pthread_cond_signal(&liveReady);
+        pthread_mutex_unlock(&liveLock);
+        back = 1 - back;
+
+        // scale the next frame's work to the budget
+        work = (double)points * sweepSamples * min(2.0, max(0.5, budget / f->seconds));
+        sweepSamples = (int)min((double)SWEEP_SAMPLES, max((double)LIVE_MIN_SAMPLES, work / LIVE_POINTS));
+        points = (int)min((double)spec.points, max((double)LIVE_MIN_POINTS, work / sweepSamples));
+
+        if(live_pressed(&level)){
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        sec = (now.tv_sec - t0.tv_sec) + (now.tv_nsec - t0.tv_nsec) / 1e9;
+        if(sec < period){
+            usleep((useconds_t)((period - sec) * 1e6));
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sec = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+
+    pthread_mutex_lock(&liveLock);
+    liveQuit = 1;
+    pthread_cond_signal(&liveReady);
+    pthread_mutex_unlock(&liveLock);
+    pthread_join(viewer, NULL);
+    avgTarget = savedTarget;
+    sweepSamples = SWEEP_SAMPLES;
+    settleRetry = BATCH_MAX_WORDS;
+    printf("Live: %d frames in %.2f s, %.1f fps%s, last %d points x %d samples, %d waits for the viewer (%.1f ms)\n",
+           frames, sec, frames / sec, frames / sec < LIVE_SHORTFALL * liveFps ? " (below the target)" : "",
+           live[1 - back].points, live[1 - back].samples, liveWaits, liveWaitMs);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                USB Export
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// Finished curve files are copied to the export directory by a worker thread, so the next test doesn't wait on it.
+// The copy goes through a .part file that is synced and renamed into place. On the Pi the directory is the USB
+// stick's mount point: the worker mounts the stick when it has files to copy and unmounts it once the queue is
+// empty, so the stick can be pulled between tests. A target that isn't there keeps the files queued and the
+// worker tries again every EXPORT_RETRY_MS.
+#define EXPORT_QUEUE    64
+#define EXPORT_RETRY_MS 1000
+#define EXPORT_BUFFER   65536
+#define EXPORT_USB_DIR  "/media/pi/usbdrive"
+#define EXPORT_USB_DEV  "/dev/sda1"
+
+const char *exportDir = NULL;       // NULL = no export
+int exportMount = 0;                // exportDir is the USB stick's mount point, mount it as needed
+char exportQueue[EXPORT_QUEUE][1000];
+int exportHead = 0, exportCount = 0;
+int exportStop = 0;
+int exportFiles = 0, exportRetries = 0, exportDropped = 0;
+int exportMounted = 0;              // the worker mounted the stick
+pthread_t exportThread;
+pthread_mutex_t exportLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t exportWake = PTHREAD_COND_INITIALIZER;
+
+// 1 if dir is a mount point (on another device than its parent)
+int export_mounted(const char *dir){
+    struct stat here, parent;
+    char up[1000];
+
+    snprintf(up, sizeof(up), "%s/..", dir);
+    return stat(dir, &here) == 0 && stat(up, &parent) == 0 && here.st_dev != parent.st_dev;
+}
+
+// make the export directory available, mounting the stick if that's the target, 0 when it can take files
+int export_ready(void){
+    const char *types[] = {"vfat", "exfat", "ext4"};
+
+    if(!exportMount){
+        return access(exportDir, W_OK) == 0 ? 0 : -1;
+    }
+    if(export_mounted(exportDir)){
+        return 0;
+    }
+    mkdir(exportDir, 0755);
+    for(unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++){
+        if(mount(EXPORT_USB_DEV, exportDir, types[t], MS_NOATIME, NULL) == 0){
+            exportMounted = 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// unmount the stick if the worker mounted it
+void export_unmount(void){
+    if(exportMounted){
+        sync();
+        if(umount(exportDir) == 0){
+            rmdir(exportDir);
+        }
+        exportMounted = 0;
+    }
+}
+
+// copy name into the export directory, 0 = copied, -1 = target failed (retry), -2 = source unreadable (give up)
+int export_copy(const char *name){
+    char dest[1100], part[1110];
+    static thread_local char buffer[EXPORT_BUFFER];
+    const char *base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    int in, out, dir;
+    ssize_t n = 0;
+
+    in = open(name, O_RDONLY);
+    if(in < 0){
+        return -2;
+    }
+    snprintf(dest, sizeof(dest), "%s/%s", exportDir, base);
+    snprintf(part, sizeof(part), "%s.part", dest);
+    out = open(part, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out < 0){
+        close(in);
+        return -1;
+    }
+    while((n = read(in, buffer, sizeof(buffer))) > 0){
+        if(write(out, buffer, n) != n){
+            n = -1;
+            break;
+        }
+    }
+    close(in);
+    if(n < 0 || fsync(out) < 0){
+        close(out);
+        unlink(part);
+        return -1;
+    }
+    close(out);
+    if(rename(part, dest) < 0){
+        unlink(part);
+        return -1;
+    }
+    dir = open(exportDir, O_RDONLY);
+    if(dir >= 0){
+        fsync(dir);
+        close(dir);
+    }
+    return 0;
+}
+
+// export worker: copy the queued files in order, waiting out a missing target
+void *export_worker(void *arg){
+    char name[1000];
+    struct timespec until;
+    int result, failing = 0;
+
+    rt_release();
+    pthread_mutex_lock(&exportLock);
+    while(1){
+        while(exportCount == 0 && !exportStop){
+            pthread_cond_wait(&exportWake, &exportLock);
+        }
+        if(exportCount == 0){
+            break;
+        }
+        snprintf(name, sizeof(name), "%s", exportQueue[exportHead]);
+        pthread_mutex_unlock(&exportLock);
+
+        result = (export_ready() == 0) ? export_copy(name) : -1;
+        if(result == -1 && !failing){
+            printf("Export: %s not available, retrying every %d ms.\n", exportDir, EXPORT_RETRY_MS);
+        }
+        else if(result == -2){
+            printf("Export: can't read %s, skipped.\n", name);
+        }
+        failing = (result == -1);
+
+        pthread_mutex_lock(&exportLock);
+        if(failing){
+            exportRetries++;
+            if(exportStop){
+                break;
+            }
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += EXPORT_RETRY_MS / 1000;
+            until.tv_nsec += (EXPORT_RETRY_MS % 1000) * 1000000L;
+            if(until.tv_nsec >= 1000000000L){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            while(!exportStop && pthread_cond_timedwait(&exportWake, &exportLock, &until) != ETIMEDOUT);
+            continue;
+        }
+        exportFiles += (result == 0);
+        exportDropped += (result == -2);
+        exportHead = (exportHead + 1) % EXPORT_QUEUE;
+        exportCount--;
+        if(exportCount == 0){
+            pthread_mutex_unlock(&exportLock);
+            export_unmount();
+            pthread_mutex_lock(&exportLock);
+        }
+    }
+    pthread_mutex_unlock(&exportLock);
+    export_unmount();
+    return NULL;
+}
+
+// Start the export worker, if there's somewhere to export to
+int export_start(void){
+    if(exportDir == NULL){
+        return 0;
+    }
+    if(pthread_create(&exportThread, NULL, export_worker, NULL) != 0){
+        printf("Can't start the export worker.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// queue a finished file for export
+void export_file(const char *name){
+    if(exportDir == NULL){
+        return;
+    }
+    pthread_mutex_lock(&exportLock);
+    if(exportCount == EXPORT_QUEUE){
+        printf("Export: queue full, %s stays local.\n", name);
+        exportDropped++;
+    }
+    else{
+        snprintf(exportQueue[(exportHead + exportCount) % EXPORT_QUEUE], sizeof(exportQueue[0]), "%s", name);
+        exportCount++;
+        pthread_cond_signal(&exportWake);
+    }
+    pthread_mutex_unlock(&exportLock);
+}
+
+// let the worker copy what it can, one more try if the target is missing, and report
+void export_finish(void){
+    if(exportDir == NULL){
+        return;
+    }
+    pthread_mutex_lock(&exportLock);
+    exportStop = 1;
+    pthread_cond_signal(&exportWake);
+    pthread_mutex_unlock(&exportLock);
+    pthread_join(exportThread, NULL);
+    printf("Export: %d files to %s, %d retries", exportFiles, exportDir, exportRetries);
+    if(exportCount + exportDropped > 0){
+        printf(", %d not exported", exportCount + exportDropped);
+    }
+    printf("\n");
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Plotting
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// labels and headings of this test's figure, as curve.py puts them together from the CSV
+int plot_figure(plotFigure *f, int type, int subtype){
+    const char *str[] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+    const char *axes = trace_axes(subtype);
+
+    if(axes == NULL){
+        return -1;
+    }
+    snprintf(f->title, sizeof(f->title), "Curve Trace");
+    snprintf(f->heading, sizeof(f->heading), "Type: %s Subtype: %s Terminal 1: %s Terminal 2: %s Terminal 3: %s",
+             str[type], str[subtype], str[terminal_id[0]], str[terminal_id[1]], str[terminal_id[2]]);
+    sscanf(axes, "%31[^,],%31[^,],%31s", f->gateLabel, f->xLabel, f->yLabel);
+    f->xMin = 0;
+    f->xMax = PLOT_XMAX;
+    return 0;
+}
+
+// draw this test's curves as curve.py would, to PNG and SVG next to the curve file
+void plot_curves(int type, int subtype){
+    char png[1000], svg[1000];
+    int n = strrchr(fname, '.') ? strrchr(fname, '.') - fname : strlen(fname);
+    struct timespec start, stop;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(plot_figure(&figure, type, subtype) < 0){
+        return;
+    }
+    snprintf(png, sizeof(png), "%.*s.png", n, fname);
+    snprintf(svg, sizeof(svg), "%.*s.svg", n, fname);
+    if(plot_png(&figure, png) < 0 || plot_svg(&figure, svg) < 0){
+        printf("Can't write the plot of %s.\n", fname);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    printf("Plot: %s and %s in %.1f ms\n", png, svg, ((stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9) * 1000);
+    export_file(png);
+    export_file(svg);
+}
+
+// --plot worker starts plotd.py once and keeps it: each socket has a slot of shared memory (a file in /dev/shm) the
+// finished sweep is copied into, and a line "slot offset seq" on the worker's stdin tells it to redraw that
+// socket's figure. The worker answers "drawn slot seq ms" on its stdout once the figure is on screen, ms being
+// the time since the sweep finished; a listener thread reports it. A socket whose last figure isn't drawn yet
+// waits up to PLOT_ACK_MS for it before posting the next, and skips the plot after that.
+#define PLOT_SCRIPT "/home/pi/TransistorID/plotd.py"
+#define PLOT_ACK_MS 2000
+
+const char *plotScript = PLOT_SCRIPT;
+char plotShm[64];
+unsigned char *plotMap = NULL;
+size_t plotSlot;                    // bytes per socket
+pid_t plotPid = -1;
+pid_t plotChild = -1;               // plotPid goes to -1 when the worker's output ends, this one is kept to reap it
+int plotControl = -1;               // worker's stdin
+int plotReplies = -1;               // worker's stdout
+pthread_t plotThread;
+pthread_mutex_t plotLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t plotDrawn = PTHREAD_COND_INITIALIZER;
+uint32_t plotPosted[MAX_SOCKETS], plotShown[MAX_SOCKETS];
+int plotFigures = 0, plotSkipped = 0;
+double plotLatency = 0, plotWorst = 0;  // ms, summed and worst
+
+// listener: read the worker's answers and report how long each figure took to reach the screen
+void *plot_listener(void *arg){
+    FILE *in = fdopen(plotReplies, "r");
+    char line[128];
+    unsigned int slot, seq;
+    double ms;
+
+    rt_release();
+    while(in != NULL && fgets(line, sizeof(line), in) != NULL){
+        if(sscanf(line, "drawn %u %u %lf", &slot, &seq, &ms) != 3 || slot >= MAX_SOCKETS){
+            continue;
+        }
+        printf("Plot: socket %u figure %u on screen %.1f ms after the sweep\n", slot + 1, seq, ms);
+        pthread_mutex_lock(&plotLock);
+        plotShown[slot] = seq;
+        plotFigures++;
+        plotLatency += ms;
+        plotWorst = max(plotWorst, ms);
+        pthread_cond_broadcast(&plotDrawn);
+        pthread_mutex_unlock(&plotLock);
+    }
+    printf("Plot worker stopped.\n");
+    pthread_mutex_lock(&plotLock);
+    plotPid = -1;
+    pthread_cond_broadcast(&plotDrawn);
+    pthread_mutex_unlock(&plotLock);
+    return NULL;
+}
+
+// map the slots and start the worker, once per run
+int plot_worker_start(void){
+    int control[2], replies[2], fd;
+
+    if(plotMode != PLOT_WORKER){
+        return 0;
+    }
+    plotSlot = sizeof(plotShared) + 2 * PLOT_MAX_CURVES * spec.points * sizeof(double);
+    snprintf(plotShm, sizeof(plotShm), "/dev/shm/tracer-plot-%d", (int)getpid());
+    fd = open(plotShm, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0 || ftruncate(fd, MAX_SOCKETS * plotSlot) < 0){
+        perror(plotShm);
+        return -1;
+    }
+    plotMap = (unsigned char *)mmap(NULL, MAX_SOCKETS * plotSlot, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(plotMap == MAP_FAILED || pipe(control) < 0 || pipe(replies) < 0){
+        perror("plot worker");
+        return -1;
+    }
+
+    plotChild = plotPid = fork();
+    if(plotPid == 0){
+        dup2(control[0], STDIN_FILENO);
+        dup2(replies[1], STDOUT_FILENO);
+        close(control[0]); close(control[1]); close(replies[0]); close(replies[1]);
+        execlp("python3", "python3", plotScript, plotShm, (char *)NULL);
+        perror(plotScript);
+        _exit(127);
+    }
+    close(control[0]);
+    close(replies[1]);
+    if(plotPid < 0){
+        perror("fork");
+        return -1;
+    }
+    plotControl = control[1];
+    plotReplies = replies[0];
+    signal(SIGPIPE, SIG_IGN);       // a worker that died shows up as a failed write
+    if(pthread_create(&plotThread, NULL, plot_listener, NULL) != 0){
+        printf("Can't start the plot listener.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// copy the curves of f into the socket's slot and tell the worker; done is when the sweep finished. Waits up to
+// waitMs for the worker to draw the socket's last figure.
+void plot_post(plotFigure *f, int type, int subtype, const struct timespec *done, int waitMs){
+    plotShared *h = (plotShared *)(plotMap + sock->index * plotSlot);
+    double *x = (double *)(h + 1), *y = x + PLOT_MAX_CURVES * spec.points;
+    struct timespec until;
+    char line[64];
+    int busy;
+
+    if(plotMap == NULL || plot_figure(f, type, subtype) < 0){
+        return;
+    }
+
+    // the worker may still be reading the last figure
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += waitMs / 1000;
+    until.tv_nsec += (waitMs % 1000) * 1000000L;
+    if(until.tv_nsec >= 1000000000L){
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&plotLock);
+    while(plotPid > 0 && plotShown[sock->index] != plotPosted[sock->index] && pthread_cond_timedwait(&plotDrawn, &plotLock, &until) != ETIMEDOUT);
+    busy = (plotPid <= 0 || plotShown[sock->index] != plotPosted[sock->index]);
+    plotSkipped += (busy && waitMs > 0);
+    pthread_mutex_unlock(&plotLock);
+    if(busy && waitMs > 0){
+        printf("Plot worker %s, socket %d not plotted.\n", plotPid <= 0 ? "not running" : "busy", sock->index + 1);
+    }
+    if(busy){
+        return;
+    }
+
+    h->magic = PLOT_SHM_MAGIC;
+    h->done = done->tv_sec + done->tv_nsec / 1e9;
+    h->curves = f->curves;
+    h->stride = spec.points;
+    for(int k = 0; k < f->curves; k++){
+        h->gate[k] = f->curve[k].gate;
+        h->count[k] = f->curve[k].count;
+        memcpy(x + k * spec.points, f->curve[k].x, f->curve[k].count * sizeof(double));
+        memcpy(y + k * spec.points, f->curve[k].y, f->curve[k].count * sizeof(double));
+    }
+    snprintf(h->heading, sizeof(h->heading), "%s", f->heading);
+    snprintf(h->labels, sizeof(h->labels), "%s,%s,%s", f->gateLabel, f->xLabel, f->yLabel);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    pthread_mutex_lock(&plotLock);
+    h->seq = ++plotPosted[sock->index];
+    snprintf(line, sizeof(line), "%d %zu %u\n", sock->index, sock->index * plotSlot, h->seq);
+    if(write(plotControl, line, strlen(line)) < 0){
+        plotPosted[sock->index]--;
+        printf("Plot worker not running, socket %d not plotted.\n", sock->index + 1);
+    }
+    pthread_mutex_unlock(&plotLock);
+}
+
+// a progressive sweep's preview: redraw the PNG, or hand it to the worker if it's free, on the processing thread
+void plot_preview(plotFigure *f, int type, int subtype){
+    char png[1000];
+    int n = strrchr(fname, '.') ? strrchr(fname, '.') - fname : strlen(fname);
+    struct timespec now;
+
+    if(plotMode == PLOT_NATIVE && plot_figure(f, type, subtype) == 0){
+        snprintf(png, sizeof(png), "%.*s.png", n, fname);
+        plot_png(f, png);
+    }
+    else if(plotMode == PLOT_WORKER){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        plot_post(f, type, subtype, &now, 0);
+    }
+}
+
+// close the worker's stdin, which ends it, and report the latencies
+void plot_worker_finish(void){
+    if(plotMode != PLOT_WORKER || plotMap == NULL){
+        return;
+    }
+    close(plotControl);
+    pthread_join(plotThread, NULL);
+    if(plotChild > 0){
+        waitpid(plotChild, NULL, 0);    // the worker exits at the end of its stdin
+    }
+    unlink(plotShm);
+    if(plotFigures > 0){
+        printf("Plot worker: %d figures, %.1f ms average and %.1f ms worst from sweep to screen", plotFigures, plotLatency / plotFigures, plotWorst);
+        if(plotSkipped > 0){
+            printf(", %d skipped", plotSkipped);
+        }
+        printf("\n");
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Transfer Characteristic
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// --transfer V measures the identified part's transfer characteristic instead of its output curves: VDS/VCE is held
+// at V (VSD/VEC for P parts) and the gate/base DAC is stepped through adcdac_return's terminal mapping, reading the
+// gate/base terminal as well. A coarse pass over the whole range finds where the part turns on, then the remaining
+// points go into that region. The threshold (or VBE(on)), peak transconductance and, for BJTs, hFE come out of
+// the one curve, which goes to <type>_<subtype>_transfer_<n>.csv.
+#define TRANSFER_POINTS 250     // fine pass
+#define TRANSFER_COARSE 32
+#define TRANSFER_ON     0.01    // the fine pass starts where the current passes this fraction of the coarse peak
+#define TRANSFER_TOP    0.95    // and ends where it passes this one
+#define TRANSFER_WINDOW 2       // points either side in a slope fit
+#define TRANSFER_ION    1e-4    // A, collector current VBE(on) is read at
+#define TRANSFER_VCESAT 0.3     // V, below this the BJT is saturated and left out of hFE
+#define TRANSFER_MIN_IB 1e-5    // A, smaller base currents are too close to the ADC noise for hFE
+
+double transferVolts = 0;       // VDS/VCE held, 0 = output characteristics
+int transferPoints = TRANSFER_POINTS;
+
+struct transferPoint{
+    double drive;               // gate/base DAC above the source/emitter rail, V
+    double vc, i;               // VGS/VBE as measured and the drain/collector current (negative for P parts)
+    double vo, ic;              // VDS/VCE and the gate/base current
+};
+
+int transfer_order(const void *a, const void *b){
+    double d = ((const transferPoint *)a)->drive - ((const transferPoint *)b)->drive;
+    return (d > 0) - (d < 0);
+}
+
+// measure one point with the gate/base DAC drive volts above the source/emitter rail
+void transfer_point(transferPoint *p, double drive, int vds, int subtype, int t1, int t2, int t3){
+    int pmos = (subtype == PMOS || subtype == PNP);
+    int src;
+
+    memset(p, 0, sizeof(*p));
+    p->drive = drive;
+    adcdac_return(vds, pmos ? VMAX - drive : drive, t1, t2, t3, subtype);
+    if(spiFailed){
+        return;
+    }
+    sweep_convert(&pointRec, subtype, &p->vo, &p->i);
+    src = pointRec.sum[0] / pointRec.cnt[0];
+    p->vc = (double)(pmos ? src - gateRead : gateRead - src) / ADCMAX * VMAX;
+    p->ic = (double)(volts[gateTerminal] - gateRead) / ADCMAX * VMAX / RESISTOR;
+}
+
+// least squares slope of |current| (or its square root) against |VGS/VBE| over the points around j
+double transfer_slope(const transferPoint *p, int n, int j, int root, double *xMean, double *yMean){
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, x, y;
+    int first = max(0, j - TRANSFER_WINDOW), last = min(n - 1, j + TRANSFER_WINDOW), m = last - first + 1;
+
+    for(int k = first; k <= last; k++){
+        x = p[k].vc;
+        y = root ? sqrt(fabs(p[k].i)) : fabs(p[k].i);
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    *xMean = sx / m;
+    *yMean = sy / m;
+    return (m * sxx - sx * sx > 1e-12) ? (m * sxy - sx * sy) / (m * sxx - sx * sx) : 0;
+}
+
+// threshold, transconductance and gain of the measured curve
+void transfer_extract(const transferPoint *p, int n, int type, int subtype){
+    double slope, x, y, best = 0, gm = 0, gmAt = 0, vth = 0, hfe = 0, von = 0;
+    double sign = (subtype == PMOS || subtype == PNP) ? -1 : 1;
+    int used = 0;
+
+    for(int j = 0; j < n; j++){
+        slope = transfer_slope(p, n, j, 0, &x, &y);
+        if(slope > gm){
+            gm = slope; gmAt = x;
+        }
+    }
+    if(type == MOSFET){
+        // extrapolate the steepest part of sqrt(ID) against VGS down to zero current
+        for(int j = 0; j < n; j++){
+            slope = transfer_slope(p, n, j, 1, &x, &y);
+            if(slope > best){
+                best = slope; vth = x - y / slope;
+            }
+        }
+        printf("Vth %.3f V, gm %.2f mS at VGS %.3f V\n", sign * vth, gm * 1e3, sign * gmAt);
+        return;
+    }
+
+    for(int j = 1; j < n && von == 0; j++){
+        if(fabs(p[j].i) >= TRANSFER_ION && fabs(p[j-1].i) < TRANSFER_ION){
+            von = p[j-1].vc + (p[j].vc - p[j-1].vc) * (TRANSFER_ION - fabs(p[j-1].i)) / (fabs(p[j].i) - fabs(p[j-1].i));
+        }
+    }
+    for(int j = 0; j < n; j++){
+        if(fabs(p[j].vo) >= TRANSFER_VCESAT && fabs(p[j].ic) >= TRANSFER_MIN_IB){
+            hfe += fabs(p[j].i / p[j].ic);
+            used++;
+        }
+    }
+    printf("VBE(on) %.3f V at %.1f mA, gm %.2f mS at VBE %.3f V, ", sign * von, TRANSFER_ION * 1e3, gm * 1e3, sign * gmAt);
+    if(used > 0){
+        printf("hFE %.1f over %d points\n", hfe / used, used);
+    }
+    else{
+        printf("no points in the active region for hFE\n");
+    }
+}
+
+// the curve to the transfer CSV and, with --plot native, to PNG and SVG next to it
+void transfer_write(const transferPoint *p, int n, int type, int subtype){
+    const char *control = (type == BJT) ? (subtype == PNP ? "$V_{EB}$" : "$V_{BE}$") : (subtype == PMOS ? "$V_{SG}$" : "$V_{GS}$");
+    char png[1000], svg[1000], held[32], current[32];
+    int len = strrchr(fname, '.') - fname;
+    FILE *ofp = fopen(fname, "w");
+    double *x, *y;
+
+    if(ofp == NULL){
+        perror(fname);
+        return;
+    }
+    sscanf(trace_axes(subtype), "%*[^,],%31[^,],%31s", held, current);
+    fprintf(ofp, "Type: %s,Subtype: %s,%s = %.2f\n", trace_name(type), trace_name(subtype), held, transferVolts);
+    fprintf(ofp, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", trace_name(terminal_id[0]), trace_name(terminal_id[1]), trace_name(terminal_id[2]));
+    fprintf(ofp, "%s,%s,%s,%s\n", control, current, held, (type == BJT) ? "$I_B$" : "$I_G$");
+    for(int j = 0; j < n; j++){
+        fprintf(ofp, "%f,%e,%f,%e\n", p[j].vc, p[j].i, p[j].vo, p[j].ic);
+    }
+    fclose(ofp);
+
+    x = (double *)malloc(2 * n * sizeof(double));
+    if(plotMode != PLOT_NATIVE || x == NULL || plot_figure(&figure, type, subtype) < 0){
+        free(x);
+        return;
+    }
+    y = x + n;
+    figure.xMax = 0.5;
+    for(int j = 0; j < n; j++){
+        x[j] = p[j].vc;
+        y[j] = p[j].i;
+        figure.xMax = max(figure.xMax, ceil(x[j] * 2) / 2);     // to the next half volt
+    }
+    snprintf(figure.title, sizeof(figure.title), "Transfer Characteristic");
+    snprintf(figure.gateLabel, sizeof(figure.gateLabel), "%s", held);
+    snprintf(figure.xLabel, sizeof(figure.xLabel), "%s", control);
+    figure.curves = 1;
+    figure.curve[0].gate = transferVolts;
+    figure.curve[0].count = n;
+    figure.curve[0].x = x;
+    figure.curve[0].y = y;
+    snprintf(png, sizeof(png), "%.*s.png", len, fname);
+    snprintf(svg, sizeof(svg), "%.*s.svg", len, fname);
+    if(plot_png(&figure, png) == 0 && plot_svg(&figure, svg) == 0){
+        printf("Plot: %s and %s\n", png, svg);
+        export_file(png);
+        export_file(svg);
+    }
+    free(x);
+}
+
+// coarse pass, fine pass over where the part turns on, then the curve, its parameters and file
+void transfer_run(int type, int subtype, int t1, int t2, int t3){
+    char str[][15] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+    char prefix[10];
+    int pmos = (subtype == PMOS || subtype == PNP), fcount = 1;
+    int vds = (int)((pmos ? VMAX - transferVolts : transferVolts) * ADCMAX / VMAX);
+    int n = 0, on = -1, top = TRANSFER_COARSE - 1;
+    double peak = 0, lo, hi, step = VMAX / (TRANSFER_COARSE - 1);
+    transferPoint *p = (transferPoint *)malloc((TRANSFER_COARSE + transferPoints) * sizeof(transferPoint));
+    struct timespec start, stop;
+
+    if(p == NULL){
+        printf("Transfer: out of memory for %d points.\n", transferPoints);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sweepReadGate = 1;
+    for(int j = 0; j < TRANSFER_COARSE; j++){
+        transfer_point(&p[n], j * step, vds, subtype, t1, t2, t3);
+        peak = max(peak, fabs(p[n].i));
+        n++;
+    }
+    for(int j = 0; j < TRANSFER_COARSE; j++){
+        if(on < 0 && fabs(p[j].i) >= TRANSFER_ON * peak){
+            on = j;
+        }
+        if(on >= 0 && fabs(p[j].i) >= TRANSFER_TOP * peak){
+            top = j;
+            break;
+        }
+    }
+    lo = max(0, on - 1) * step;
+    hi = min(TRANSFER_COARSE - 1, top + 1) * step;
+    for(int j = 0; j < transferPoints && on >= 0 && peak > 0; j++){
+        transfer_point(&p[n++], lo + (hi - lo) * (j + 1) / (transferPoints + 1), vds, subtype, t1, t2, t3);
+    }
+    sweepReadGate = 0;
+    if(spiFailed){
+        printf("Transfer: SPI transfer failed, no curve written.\n");
+        free(p);
+        return;
+    }
+    qsort(p, n, sizeof(transferPoint), transfer_order);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    sock->sweepSeconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("\nTransfer %s at %s %.2f V: %d points, fine pass %.3f-%.3f V drive, %.3f s\n", str[subtype],
+           (type == BJT) ? (pmos ? "VEC" : "VCE") : (pmos ? "VSD" : "VDS"), transferVolts, n, lo, hi, sock->sweepSeconds);
+    transfer_extract(p, n, type, subtype);
+
+    sprintf(prefix, socketCount > 1 ? "S%d_" : "", sock->index + 1);
+    sprintf(fname, "%s%s_%s_transfer_%d.csv", prefix, str[type], str[subtype], fcount);
+    while (access(fname, F_OK) != -1){
+        fcount++;
+        sprintf(fname, "%s%s_%s_transfer_%d.csv", prefix, str[type], str[subtype], fcount);
+    }
+    transfer_write(p, n, type, subtype);
+    snprintf(sock->file, sizeof(sock->file), "%s", fname);
+    export_file(fname);
+    free(p);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+                                                                Production Mode
+
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
+
+// --production runs the tracer behind a parts handler: each start trigger tests every socket without the display,
+// plots or USB copy, one line per part goes to the run log, and the run keeps throughput, phase times and yield.
+// The trigger is the test button line (wired to the handler's part present signal) or a local stream socket
+// taking "start" and "stop" lines and answering each start with one result line per socket.
+#define TRIGGER_GPIO   0
+#define TRIGGER_SOCKET 1
+#define TRIGGER_LINE   64
+
+int production = 0;
+FILE *runLog = NULL;
+int triggerSource = TRIGGER_GPIO;
+const char *triggerPath = NULL;
+int triggerFd = -1, triggerClient = -1;
+
+struct productionStats{
+    struct timespec start, last;    // first trigger, end of the last round
+    long parts, identified, rounds;
+    double waitSeconds;         // handler time between rounds
+    double idSeconds, sweepSeconds, testSeconds;   // summed over parts
+};
+
+productionStats prod;
+
+// open the run log for appending, with a header when it's new
+int runlog_open(const char *name){
+    runLog = fopen(name, "a");
+    if(runLog == NULL){
+        perror(name);
+        return -1;
+    }
+    if(ftell(runLog) == 0){
+        fprintf(runLog, "time,round,socket,result,type,subtype,terminal1,terminal2,terminal3,identify_s,sweep_s,test_s,file\n");
+    }
+    return 0;
+}
+
+// listen on the trigger socket, 0 when the trigger is the GPIO line
+int trigger_open(void){
+    struct sockaddr_un addr;
+
+    if(triggerSource != TRIGGER_SOCKET){
+        return 0;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(triggerPath) >= sizeof(addr.sun_path)){
+        printf("Trigger socket path too long.\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, triggerPath);
+    unlink(triggerPath);
+    triggerFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(triggerFd < 0 || bind(triggerFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(triggerFd, 1) < 0){
+        perror(triggerPath);
+        return -1;
+    }
+    printf("Waiting for start triggers on %s\n", triggerPath);
+    return 0;
+}
+
+// next line from the handler, 1 = line, 0 = timeout, -1 = handler hung up
+int trigger_line(char *line, int timeoutMs){
+    struct pollfd pfd = {triggerClient, POLLIN, 0};
+    int n = 0;
+    char c;
+
+    while(n < TRIGGER_LINE - 1){
+        if(poll(&pfd, 1, timeoutMs > 0 ? timeoutMs : -1) == 0){
+            return 0;
+        }
+        if(read(triggerClient, &c, 1) != 1){
+            return -1;
+        }
+        if(c == '\n'){
+            break;
+        }
+        if(c != '\r'){
+            line[n++] = c;
+        }
+    }
+    line[n] = 0;
+    return 1;
+}
+
+// wait for the handler's start trigger, 1 = start, 0 = stop or timeout, -1 = error
+int trigger_wait(void){
+    char line[TRIGGER_LINE];
+    struct pollfd pfd = {triggerFd, POLLIN, 0};
+
+    if(triggerSource == TRIGGER_GPIO){
+        return button_wait(buttonTimeout);
+    }
+    while(1){
+        if(triggerClient < 0){
+            if(poll(&pfd, 1, buttonTimeout > 0 ? buttonTimeout : -1) == 0){
+                return 0;
+            }
+            triggerClient = accept(triggerFd, NULL, NULL);
+            if(triggerClient < 0){
+                perror("accept");
+                return -1;
+            }
+        }
+        switch(trigger_line(line, buttonTimeout)){
+            case 0:
+                return 0;
+            case -1:
+                close(triggerClient);
+                triggerClient = -1;
+                continue;
+        }
+        if(strcmp(line, "start") == 0){
+            return 1;
+        }
+        if(strcmp(line, "stop") == 0){
+            dprintf(triggerClient, "stopped\n");
+            return 0;
+        }
+        dprintf(triggerClient, "unknown command %s\n", line);
+    }
+}
+
+// log the round's parts, answer the handler and add them to the run totals
+void production_record(double waitSeconds){
+    const char *name[] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+    char stamp[32];
+    time_t now = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    if(prod.rounds++ > 0){
+        prod.waitSeconds += waitSeconds;
+    }
+    for(int k = 0; k < socketCount; k++){
+        tracerSocket *s = &sockets[k];
+        int ok = (s->type != TBD);
+
+        prod.parts++;
+        prod.identified += ok;
+        prod.idSeconds += s->idSeconds;
+        prod.sweepSeconds += s->sweepSeconds;
+        prod.testSeconds += s->testSeconds;
+        if(ok){
+            fprintf(runLog, "%s,%ld,%d,PASS,%s,%s,%s,%s,%s,%.3f,%.3f,%.3f,%s\n", stamp, prod.rounds, k + 1, name[s->type], name[s->subtype],
+                    name[s->id[0]], name[s->id[1]], name[s->id[2]], s->idSeconds, s->sweepSeconds, s->testSeconds, s->file);
+        }
+        else{
+            fprintf(runLog, "%s,%ld,%d,ERROR,,,,,,%.3f,,%.3f,\n", stamp, prod.rounds, k + 1, s->idSeconds, s->testSeconds);
+        }
+        if(triggerClient >= 0){
+            if(ok){
+                dprintf(triggerClient, "S%d PASS %s %s %s %s %s\n", k + 1, name[s->type], name[s->subtype], name[s->id[0]], name[s->id[1]], name[s->id[2]]);
+            }
+            else{
+                dprintf(triggerClient, "S%d ERROR\n", k + 1);
+            }
+        }
+    }
+    fflush(runLog);
+    clock_gettime(CLOCK_MONOTONIC, &prod.last);
+}
+
+// throughput and yield after each round; the summary at the end of the run breaks the time down per part
+void production_report(int summary){
+    double elapsed, busy;
+
+    if(prod.parts == 0){
+        return;
+    }
+    elapsed = (prod.last.tv_sec - prod.start.tv_sec) + (prod.last.tv_nsec - prod.start.tv_nsec) / 1e9;
+    busy = elapsed - prod.waitSeconds;
+    if(!summary){
+        printf("Production: %ld parts, %ld identified, %ld errors (yield %.1f%%), %.0f devices/hour (%.0f excluding handler time)\n",
+               prod.parts, prod.identified, prod.parts - prod.identified, 100.0 * prod.identified / prod.parts,
+               prod.parts * 3600 / elapsed, prod.parts * 3600 / busy);
+    }
+    else{
+        printf("Production: %.1f s run, per part %.3f s identify, %.3f s sweep, %.3f s other, %.3f s handler\n", elapsed,
+               prod.idSeconds / prod.parts, prod.sweepSeconds / prod.parts, (prod.testSeconds - prod.idSeconds - prod.sweepSeconds) / prod.parts,
+               prod.waitSeconds / prod.parts);
+    }
+    printf("\n");
+}
 
-// output curve trace data to file
-void print_csv(float vgs, int type, int subtype, int t1, int t2, int t3){
-    FILE *ofp;
-    char str[][15] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
-
-    // char outputFilename[] = "curve.csv";
+/* ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    // set when to write and when to append file
-	if( (subtype == NPN && vgs == NbjtBase[0]) || (subtype == PNP && vgs == PbjtBase[0]) || (subtype == NMOS && (vgs == 0)) || (subtype == PMOS && (vgs == 5)) ){
-        ofp = fopen(fname, "w"); // write
+                                                                Test Sockets
 
-        switch(subtype){
-            case NPN:
-                fprintf(ofp, "Type: %s,Subtype: %s,\n", str[type],str[subtype]);
-                fprintf(ofp, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", str[terminal_id[0]], str[terminal_id[1]], str[terminal_id[2]]);
-                fprintf(ofp, "$V_{B}$,$V_{CE}$,$I_C$\n");
-                break;
-            case NMOS:
-                fprintf(ofp, "Type: %s,Subtype: %s,\n", str[type],str[subtype]);
-                fprintf(ofp, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", str[terminal_id[0]], str[terminal_id[1]], str[terminal_id[2]]);
-                fprintf(ofp, "$V_{G}$,$V_{DS}$,$I_D$\n");
-                break;
-            case PNP:
-                fprintf(ofp, "Type: %s,Subtype: %s,\n", str[type],str[subtype]);
-                fprintf(ofp, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", str[terminal_id[0]], str[terminal_id[1]], str[terminal_id[2]]);
-                fprintf(ofp, "$V_{B}$,$V_{EC}$,$I_C$\n");
-                break;
-            case PMOS:
-                fprintf(ofp, "Type: %s,Subtype: %s,\n", str[type],str[subtype]);
-                fprintf(ofp, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", str[terminal_id[0]], str[terminal_id[1]], str[terminal_id[2]]);
-                fprintf(ofp, "$V_{G}$,$V_{SD}$,$I_D$\n");
-                break;
-            default:
-                break;
-        }
-    }
-    else{
-        ofp = fopen(fname, "a"); // append
-    }
-	int i;
-
-	for(i=0;i<=SAMPLES-1;i++){
-		fprintf(ofp, "%f,%f,%f\n", vgs, voltsVDS[i], curr[i]);
-	}
-	fclose(ofp);
-}
+------------------------------------------------------------------------------------------------------------------------------------------------------------------------------ */
 
-// extension of adcdac_return function
-void adcdac_returnExt(int gateBase, int srcEmitter, int drainCollector, int* ADC1drop, int subtype){
+// With --sockets N every socket gets its own thread running the whole test against its own board. The measurement
+// state is thread_local, so each thread sees its socket's; the threads only meet at the bus scheduler, the
+// display and the test button.
+pthread_mutex_t sockLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sockStart = PTHREAD_COND_INITIALIZER;
+pthread_cond_t sockDone = PTHREAD_COND_INITIALIZER;
+int sockRound = 0;                  // test rounds started
+const char *socketParts = NULL;     // simulated parts, one per socket, comma separated
+const char *socketPins = NULL;
 
-        int ADC1read, ADC1readSum, ADC1cnt, spiInCheck;
-        int ADC2read, ADC2readSum, ADC2cnt;
-        int diffCnt; int diffHoldSum; int diff;
-
-        // write out to DACs
-        spiOut[0] = (volts[0] | DAC0_WRITE) >> 8;   // Term 1
-        spiOut[1] = (volts[0] | DAC0_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        spiOut[0] = (volts[1] | DAC1_WRITE) >> 8;   // Term 2
-        spiOut[1] = (volts[1] | DAC1_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        spiOut[0] = (volts[2] | DAC2_WRITE) >> 8;   // Term 3
-        spiOut[1] = (volts[2] | DAC2_WRITE) & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        spiOut[0] = ADCSEQUENCE >> 8;
-        spiOut[1] = ADCSEQUENCE & 0x00FF;
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        makeWord(spiOut, 0b0000000000000000); //no op command, data in
-        bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-
-        ADC1readSum = 0; ADC1cnt = 0;
-        ADC2readSum = 0; ADC2cnt = 0;
-        diffHoldSum = 0; diffCnt = 0;
-
-        for(int ii = 0; ii < 199; ii++){
-            makeWord(spiOut, 0b0000000000000000); //no op command, data in
-            bcm2835_spi_transfernb(spiOut, spiIn, WORD_SIZE);
-            spiInCheck = (spiIn[0] >> 4) & 0x07;
-
-            // take readings from source and drain of device
-            if(spiInCheck == srcEmitter + 4){
-                spiIn[0] = spiIn[0] & 0x0F;
-                ADC1read = spiIn[0]; // Place result into read-out array
-                ADC1read = (ADC1read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                ADC1readSum += ADC1read;
-                ADC1cnt++;
-            }
+// item k of a comma separated list, the last one if the list is shorter
+void list_item(const char *list, int k, char *out, int size){
+    const char *end;
 
-            if(spiInCheck == drainCollector + 4){
-                spiIn[0] = spiIn[0] & 0x0F;
-                ADC2read = spiIn[0]; // Place result into read-out array
-                ADC2read = (ADC2read << 8) | spiIn[1];    // Change spiIn 0 to most significant bits, OR with spiIn 1 to create word
-                ADC2readSum += ADC2read;
-                ADC2cnt++;
-            }
-            //diff = ADC2read - ADC1read;
-            //diffHoldSum += diff;
-            //diffCnt++;
+    for(end = strchr(list, ','); k > 0 && end != NULL; k--){
+        list = end + 1;
+        end = strchr(list, ',');
+    }
+    snprintf(out, size, "%.*s", end ? (int)(end - list) : (int)strlen(list), list);
+}
 
-        }
-            // output collector/drain current readings
-            ADC1read = ADC1readSum / ADC1cnt;
-            ADC2read = ADC2readSum / ADC2cnt;
-            *ADC1drop = volts[drainCollector] - ADC2read;
+// per-socket setup, on the socket's own thread
+int socket_setup(void){
+    char part[20], pins[20], device[100];
 
-            if (subtype == NPN || subtype == NMOS){
-                voltsVDS[xAxisCnt] = (ADC2read - ADC1read); // was (ADC2read - ADC1read)
-            }
-            else if (subtype == PNP || subtype == PMOS){
-                voltsVDS[xAxisCnt] = (ADC1read - ADC2read);
-            }
-            voltsVDS[xAxisCnt] =  (voltsVDS[xAxisCnt] / ADCMAX) * VMAX;
+    simSeed = simSeedBase + sock->index;
+    if(sweep_alloc() < 0){
+        return -1;
+    }
+    if(socketParts != NULL){
+        list_item(socketParts, sock->index, part, sizeof(part));
+        if(socketPins != NULL){
+            list_item(socketPins, sock->index, pins, sizeof(pins));
+        }
+        if(sim_socket(part, socketPins ? pins : NULL) < 0){
+            printf("Unknown simulated part %s %s.\n", part, socketPins ? pins : "");
+            return -1;
+        }
+    }
+    if(spiBackend == SPI_SPIDEV){
+        // chip select k is the next spidev node up from the given one
+        snprintf(device, sizeof(device), "%s", spiDevice);
+        device[strlen(device) - 1] += sock->index;
+        if(spidev_init(device) < 0){
+            printf("Can't open %s.\n", device);
+            return -1;
+        }
+    }
+    return 0;
 }
 
-// adcdac_return function grabs the current values from the device for the curve trace and outputs it to the curve trace file function
-int adcdac_return(int vds, float vgs, int t1, int t2, int t3, int subtype){
+// one test of the part in this thread's socket: identify it, show it and sweep its curves
+void socket_test(void){
+    int type=0, subtype=0, fcount=1;
+    char str[][15] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+    char prefix[10];
+    struct timespec testStart, testStop, phase;
 
-    int ADC1drop, ADC2drop;
+    clock_gettime(CLOCK_MONOTONIC, &testStart);
+    sock->sweepSeconds = 0;
+    sock->file[0] = 0;
 
-    if( (subtype == NMOS) || (subtype == NPN) ){    // NMOS/NPN first
+    terminal_id[0] = TBD; terminal_id[1] = TBD; terminal_id[2] = TBD;
+    spiFailed = 0;
+    adc_stats_reset();
+    AD5592_reset();
+    AD5592_config();
+    fcount=1;
 
-        // run through each possible iteration and output required curve trace test voltages to device under test
-        if( (t1 == GATE) || (t1 == BASE) ){
-            if( (t2 == SOURCE) || (t2 == EMITTER) ){
-                volts[0] = (vgs*ADCMAX)/VMAX; volts[1] = GROUNDED; volts[2] = vds; // set proper output voltages
-                adcdac_returnExt(0, 1, 2, &ADC1drop, subtype); // send them to the extension function
-                return ADC1drop; // return the drop
-            }
-            else {
-                volts[0] = (vgs*ADCMAX)/VMAX; volts[2] = GROUNDED; volts[1] = vds;
-                adcdac_returnExt(0, 2, 1, &ADC1drop, subtype);
-                return ADC1drop;
-            }
-        }
-
-        else if( (t2 == GATE) || (t2 == BASE) ){
-            if( (t1 == SOURCE) || (t1 == EMITTER) ){
-                volts[0] = GROUNDED; volts[1] = (vgs*ADCMAX)/VMAX; volts[2] = vds;
-                adcdac_returnExt(1, 0, 2, &ADC1drop, subtype);
-                return ADC1drop;
-            }
-            else{
-                volts[2] = GROUNDED; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = vds;
-                adcdac_returnExt(1, 2, 0, &ADC1drop, subtype);
-                return ADC1drop;
+    // the meat and potatoes
+    calVolts = AD5592_calibration();
+    id_clear();
+    id_capture();
+    switch(volt_cycle(mosfet[0], mosfet[1], mosfet[2])){	//This will determine terminal identity, type, and subtype.
+        case 1:
+            terminal_id[0] = GATE;
+            type = MOSFET;
+            subtype = type_finder(1, 0);
+            drain_source(1,2,0,subtype);
+            break;
+        case 2:
+            terminal_id[1] = GATE;
+            type = MOSFET;
+            subtype = type_finder(0, 1);
+            drain_source(0,2,1,subtype);
+            break;
+        case 3:
+            terminal_id[2] = GATE;
+            type = MOSFET;
+            subtype = type_finder(0, 2);
+            drain_source(1,0,2,subtype);
+            break;
+        default:
+            type = BJT;
+            subtype = bjt_typer(/*mosfet[0], mosfet[1], mosfet[2]*/);
+            if(terminal_id[0]==BASE){
+                bjt_terminal_id(subtype, 0);
+            } else if (terminal_id[1]==BASE){
+                bjt_terminal_id(subtype, 1);
+            } else if (terminal_id[2]==BASE){
+                bjt_terminal_id(subtype, 2);
             }
-        }
+            break;
+    }
+    adc_stats_report("Identification");
+    id_report();
+    clock_gettime(CLOCK_MONOTONIC, &phase);
+    sock->idSeconds = (phase.tv_sec - testStart.tv_sec) + (phase.tv_nsec - testStart.tv_nsec) / 1e9;
 
-        else if( (t1 == SOURCE) || (t1 == EMITTER) ){
-            volts[0] = GROUNDED; volts[1] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
-            adcdac_returnExt(2, 0, 1, &ADC1drop, subtype);
-            return ADC1drop;
-        }
-        else{
-                volts[1] = GROUNDED; volts[0] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
-                adcdac_returnExt(2, 1, 0, &ADC1drop, subtype);
-                return ADC1drop;
+    // error check
+    if(spiFailed){
+        printf("SPI transfer failed.  Check the bus and try again.\n");
+    }
+    else if((type == TBD)||(subtype == TBD)||(terminal_id[0] == TBD)||(terminal_id[1] == TBD)||(terminal_id[2] == TBD)){
+        printf("Identification Error.  Check device and try again.\n");
+    }
+    if(spiFailed || (type == TBD)||(subtype == TBD)||(terminal_id[0] == TBD)||(terminal_id[1] == TBD)||(terminal_id[2] == TBD)){
+        sock->type = TBD;
+        if(socketCount == 1 && !production){
+            seg_begin();
+            seg_show(134); //letter E for ERROR
+            seg_post(0, 1);
         }
     }
+    else{
+    display_id(terminal_id[0], terminal_id[1], terminal_id[2], type, subtype);
+    sock->type = type; sock->subtype = subtype;
+    sock->id[0] = terminal_id[0]; sock->id[1] = terminal_id[1]; sock->id[2] = terminal_id[2];
+    if(socketCount == 1 && !production){
+        Sev_seg_disp(type, subtype, terminal_id[0], terminal_id[1], terminal_id[2]);    //Type, Subtype, Terminals 1, 2, 3
+    }
+    if(liveFps > 0){
+        voltage_ranger();
+        live_run(type, subtype, terminal_id[0], terminal_id[1], terminal_id[2]);
+    }
+    else if(transferVolts > 0){
+        transfer_run(type, subtype, terminal_id[0], terminal_id[1], terminal_id[2]);
+    }
+    else{
+    printf("\nGenerating Curves...\n\n");
+    printf("Sweep %s: %d curves x %d points over %.2f V\n", spec.name, sweep_curves(type), spec.points, spec.span);
+    sprintf(prefix, socketCount > 1 ? "S%d_" : "", sock->index + 1);
+    sprintf(fname, "%s%s_%s_%d.%s", prefix, str[type], str[subtype], fcount, traceOut ? "trc" : "csv");
+    while (access(fname, F_OK) != -1){
+        fcount++;
+        sprintf(fname, "%s%s_%s_%d.%s", prefix, str[type], str[subtype],fcount, traceOut ? "trc" : "csv");
+    }
 
-    if( (subtype == PMOS) || (subtype == PNP) ){ // PMOS/PNP next
+    // curve_switch(terminal_id[0], terminal_id[1], terminal_id[2]);
 
-        if( (t1 == GATE) || (t1 == BASE) ){
-            if( (t2 == DRAIN) || (t2 == COLLECTOR) ){
-                volts[0] = (vgs*ADCMAX)/VMAX; volts[2] = FIVE_VOLTS; volts[1] = vds;
-                adcdac_returnExt(0, 2, 1, &ADC1drop, subtype);
-                return ADC1drop;
-            }
-            else {
-                volts[0] = (vgs*ADCMAX)/VMAX; volts[1] = FIVE_VOLTS; volts[2] = vds;
-                adcdac_returnExt(0, 1, 2, &ADC1drop, subtype);
-                return ADC1drop;
-            }
+    voltage_ranger();
+    adc_stats_reset();
+    current_ranger(type, subtype,terminal_id[0], terminal_id[1], terminal_id[2]);
+    adc_stats_report("Sweep");
+    if(spiFailed){
+        printf("SPI transfer failed, %s discarded.\n", fname);
+        remove(fname);
+        sock->type = TBD;
+    }
+    else{
+    snprintf(sock->file, sizeof(sock->file), "%s", fname);
+    clock_gettime(CLOCK_MONOTONIC, &testStop);
+    sock->sweepSeconds = (testStop.tv_sec - phase.tv_sec) + (testStop.tv_nsec - phase.tv_nsec) / 1e9;
+    if(plotMode == PLOT_NATIVE){
+        plot_curves(type, subtype);
+    }
+    else if(plotMode == PLOT_WORKER){
+        plot_post(&figure, type, subtype, &testStop, PLOT_ACK_MS);
+    }
+    else if(plotMode == PLOT_PYTHON){
+        char python_run[1100], csv[1000];     // room for the command and the whole csv name
+        snprintf(csv, sizeof(csv), "%s", fname);
+        if(traceOut){
+            trace_convert(fname, csv);   // curve.py reads the CSV
         }
+        snprintf(python_run, sizeof(python_run), "python /home/pi/TransistorID/curve.py %s", csv);
+        system(python_run);
+        //system("python /home/pi/TransistorID/curve.py");}
+    }
+    export_file(fname);
+    }
+    }
+    }
+    settle_report(subtype);
+    clock_gettime(CLOCK_MONOTONIC, &testStop);
+    sock->testSeconds = (testStop.tv_sec - testStart.tv_sec) + (testStop.tv_nsec - testStart.tv_nsec) / 1e9;
+    printf("Test time: %.3f s\n\n", sock->testSeconds);
+}
 
-        else if( (t2 == GATE) || (t2 == BASE) ){
-            if( (t1 == DRAIN) || (t1 == COLLECTOR) ){
-                volts[2] = FIVE_VOLTS; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = vds;
-                adcdac_returnExt(1, 2, 0, &ADC1drop, subtype);
-                return ADC1drop;
-            }
-            else{
-                volts[2] = vds; volts[1] = (vgs*ADCMAX)/VMAX; volts[0] = FIVE_VOLTS;
-                adcdac_returnExt(1, 0, 2, &ADC1drop, subtype);
-                return ADC1drop;
-            }
-        }
+// socket thread: set up, then run one test per round
+void *socket_thread(void *arg){
+    int round = 0, ok;
 
-        else if ( (t3 == GATE) || (t3 == BASE)){
-        if( (t1 == DRAIN) || (t1 == COLLECTOR) ){
-            volts[1] = FIVE_VOLTS; volts[0] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
-            adcdac_returnExt(2, 1, 0, &ADC1drop, subtype);
-            return ADC1drop;
-        }
-        else{
-            volts[0] = FIVE_VOLTS; volts[1] = vds; volts[2] = (vgs*ADCMAX)/VMAX;
-            adcdac_returnExt(2, 0, 1, &ADC1drop, subtype);
-            return ADC1drop;
+    sock = (tracerSocket *)arg;
+    ok = (socket_setup() == 0);
+
+    pthread_mutex_lock(&sockLock);
+    sock->done = ok ? 0 : -1;
+    pthread_cond_broadcast(&sockDone);
+    while(ok){
+        while(sockRound == round){
+            pthread_cond_wait(&sockStart, &sockLock);
         }
-        }
+        round = sockRound;
+        pthread_mutex_unlock(&sockLock);
+
+        socket_test();
+
+        pthread_mutex_lock(&sockLock);
+        sock->done = round;
+        pthread_cond_broadcast(&sockDone);
     }
-}
+    pthread_mutex_unlock(&sockLock);
+    return NULL;
+}
 
-// evaluates the current range of the device
-void current_ranger(int type, int subtype,int t1,int t2, int t3){
-	int i,j,k,dac,iter;
-	double result; double avr;
-	for(k=0;k<=5;k++){
-        xAxisCnt = 0; // counter used for voltage range
-        for(i=0;i<=SAMPLES-1;i++){
-
-            avr=0.0;
-            //for(j=1;j<=30;j++){
-                if (type == BJT){
-                    if (subtype == NPN){
-                        vgsCorrected = NbjtBase[k]; // set the proper range for the NPN
-                    }
-                    else if (subtype == PNP){
-                        vgsCorrected = PbjtBase[k]; // set the proper range for the PNP
-                    }
-                }
-                else if (type == MOSFET) {
-                    if(subtype == NMOS){
-                        vgsCorrected = k;
-                    }
-                    if(subtype == PMOS){    // Runs Vgs in reverse for plot
-                        vgsCorrected = 5-k;
-                    }
-                }
-
-                dac = adcdac_return(volts_adc[i], vgsCorrected, t1, t2, t3, subtype);
-                result = (double)(dac) / (float)(ADCMAX) * (float)(VMAX);
-
-                //avr = avr + result;
-            //}
-            //avr = avr / 30.0;   // average of 30 readings
-            xAxisCnt++;
-                curr[i] = result / float(RESISTOR); // result was avr
+// set up the sockets, -1 if any of them can't be tested. One socket runs on the calling thread.
+int socket_start(const char *parts, const char *pins){
+    int failed = 0;
 
-                if (subtype == PNP || subtype == PMOS){ // if the device is a PMOS or PNP, change the current to negative to flip the axis
-                    curr[i] = -curr[i];
-                }
+    socketParts = parts;
+    socketPins = pins;
+    for(int k = 0; k < socketCount; k++){
+        sockets[k].index = k;
+        sockets[k].done = -2;
+    }
+    if(socketCount == 1){
+        return socket_setup();
+    }
 
-    // eliminate first 10 points of data (ADC noise)
-    if (subtype == PNP || subtype == PMOS){
-        for (int kk = 0; kk < 10; kk++){
-            curr[kk] = curr[10];
+    for(int k = 0; k < socketCount; k++){
+        if(pthread_create(&sockets[k].thread, NULL, socket_thread, &sockets[k]) != 0){
+            printf("Can't start socket %d.\n", k + 1);
+            return -1;
         }
     }
+    pthread_mutex_lock(&sockLock);
+    for(int k = 0; k < socketCount; k++){
+        while(sockets[k].done == -2){
+            pthread_cond_wait(&sockDone, &sockLock);
+        }
+        failed |= (sockets[k].done < 0);
     }
+    pthread_mutex_unlock(&sockLock);
+    return failed ? -1 : 0;
+}
 
-    print_csv(vgsCorrected,type,subtype,t1,t2,t3); // k or vgsCorrected
+// test every socket at once and wait for the last one
+void socket_round(void){
+    pthread_mutex_lock(&sockLock);
+    sockRound++;
+    pthread_cond_broadcast(&sockStart);
+    for(int k = 0; k < socketCount; k++){
+        while(sockets[k].done != sockRound){
+            pthread_cond_wait(&sockDone, &sockLock);
+        }
     }
-    char usb_copy[1000];
-    sprintf(usb_copy, "echo \"raspberry\" | sudo -S cp %s /media/pi/usbdrive/%s", fname, fname);
-    system(usb_copy);
-    // system("echo \"raspberry\" | sudo -S cp curve.csv /media/pi/usbdrive/curve.csv");
-	system("echo \"raspberry\" | sudo -S umount /dev/sda1");
-	system("echo \"raspberry\" | sudo -S rm -r /media/pi/usbdrive");
-}
+    pthread_mutex_unlock(&sockLock);
+}
+
+// scroll every socket's result: socket number, then the part or E
+void socket_display(void){
+    const int digit[MAX_SOCKETS] = {249, 164, 176, 153};    // numbers 1 to 4
+
+    seg_begin();
+    for(int k = 0; k < socketCount; k++){
+        seg_show(digit[k]);
+        seg_hold(SEGDELAY);
+        seg_show(127); //decimal
+        seg_hold(SEGDELAY);
+        if(sockets[k].type == TBD){
+            seg_show(134); //letter E for ERROR
+            seg_hold(SEGDELAY);
+        }
+        else{
+            seg_result(sockets[k].type, sockets[k].subtype, sockets[k].id[0], sockets[k].id[1], sockets[k].id[2]);
+        }
+    }
+    seg_post(1, 1);
+}
 
 // main functions
-int main(){
-	int type=0, subtype=0, fd, fcount=1;;
+int main(int argc, char *argv[]){
+	int benchPoints = 0, sweepSet = 0;
+	int tests = 0, testCnt = 0, pressed;
+	const char *simPart = NULL, *simPins = NULL;
+	struct timespec testStart, testStop, waitStart;
+	double sec;
 
-	char str[][15] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+#ifdef AD5592_SIM
+	dev = &simDevice;
+#else
+	dev = &piDevice;
+#endif
+
+	// command line: --spidev [device] selects the kernel SPI backend, --bench N times N sweep points and exits,
+	// --sim part [--pins XYZ] [--noise LSB] [--seed N] [--tau us] tests a simulated part, --tests N stops after N tests,
+	// --avg-se LSB averages each sweep point until its standard error reaches LSB (--avg-min/--avg-max samples, --avg-log file),
+	// --sweep preset|file [--points N] [--span V] [--gates list] [--bases list] sets the curve steps and grid,
+	// --adaptive refines the VDS/VCE grid where the curves bend (--adapt-tol fraction of full scale, --adapt-budget points per curve),
+	// --sprt-alpha/--sprt-eps set the gate test error rate and the assumed per-round misvote rate,
+	// --settle-lsb/--settle-timeout set when a reading counts as settled after a DAC change and how long to wait for it,
+	// --debounce ms/--button-timeout s set how long a press has to hold and how long to wait for one (0 = forever),
+	// --sim-press ms presses the simulated button every ms (with a glitch and contact bounce) instead of holding it down,
+	// --rt [cpu] runs the acquisition under SCHED_FIFO pinned to cpu (default the last one) with memory locked,
+	// --sockets N tests N boards on chip selects 0..N-1 at once (--sim and --pins then take comma separated lists),
+	// --sim-clock makes simulated transfers take as long as on the real bus,
+	// --plot native|python|worker|none draws each test's curves to PNG/SVG, with curve.py, with the long-lived plotd.py
+	// (--plot-script file) or not at all (native on the Pi),
+	// --export dir copies the curve files to dir in the background (on the Pi the USB stick by default),
+	// --trace writes the curves as a binary trace, --to-csv file.. converts traces to CSV and exits,
+	// --production log runs unattended into the run log with the quick sweep unless one is given (--trigger gpio|socket path),
+	// --transfer V measures ID-VGS/IC-VBE at VDS/VCE V instead of the output curves (--transfer-points N in the fine pass),
+	// --progressive sweeps every 16th point of each curve first and fills in the rest in passes, previewing after each,
+	// --live fps sweeps the identified part continuously until the next press (--live-socket path streams the frames,
+	// --live-frames N stops after N)
+	for(int a = 1; a < argc; a++){
+        if(strcmp(argv[a], "--spidev") == 0){
+            spiBackend = SPI_SPIDEV;
+            if(a + 1 < argc && argv[a+1][0] != '-'){
+                snprintf(spiDevice, sizeof(spiDevice), "%s", argv[++a]);
+            }
+        }
+        else if(strcmp(argv[a], "--rt") == 0){
+            rtMode = 1;
+            if(a + 1 < argc && argv[a+1][0] != '-'){
+                rtCpu = atoi(argv[++a]);
+            }
+        }
+        else if(strcmp(argv[a], "--bench") == 0 && a + 1 < argc){
+            benchPoints = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--sim") == 0 && a + 1 < argc){
+            dev = &simDevice;
+            simPart = argv[++a];
+        }
+        else if(strcmp(argv[a], "--pins") == 0 && a + 1 < argc){
+            simPins = argv[++a];
+        }
+        else if(strcmp(argv[a], "--noise") == 0 && a + 1 < argc){
+            simNoise = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--tau") == 0 && a + 1 < argc){
+            simTau = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--seed") == 0 && a + 1 < argc){
+            simSeedBase = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--avg-se") == 0 && a + 1 < argc){
+            avgTarget = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--avg-min") == 0 && a + 1 < argc){
+            avgMin = max(2, atoi(argv[++a]));
+        }
+        else if(strcmp(argv[a], "--avg-max") == 0 && a + 1 < argc){
+            avgMax = min(atoi(argv[++a]), 65535);  // 16-bit sample counts
+        }
+        else if(strcmp(argv[a], "--avg-log") == 0 && a + 1 < argc){
+            avgLog = fopen(argv[++a], "w");
+            if(avgLog == NULL){
+                perror(argv[a]);
+                return -1;
+            }
+            fprintf(avgLog, "vgs,point,samples\n");
+        }
+        else if(strcmp(argv[a], "--sweep") == 0 && a + 1 < argc){
+            if(spec_load(argv[++a]) < 0){
+                return -1;
+            }
+            sweepSet = 1;
+        }
+        else if(strcmp(argv[a], "--points") == 0 && a + 1 < argc){
+            spec.points = atoi(argv[++a]);
+            if(spec.points < 2 || spec.points > MAX_POINTS){
+                printf("--points takes 2-%d points per curve.\n", MAX_POINTS);
+                return -1;
+            }
+            sweepSet = 1;
+        }
+        else if(strcmp(argv[a], "--span") == 0 && a + 1 < argc){
+            spec.span = atof(argv[++a]);
+            sweepSet = 1;
+        }
+        else if(strcmp(argv[a], "--gates") == 0 && a + 1 < argc && (spec.mosCurves = spec_list(argv[a+1], spec.mos)) > 0){
+            a++;
+            sweepSet = 1;
+        }
+        else if(strcmp(argv[a], "--bases") == 0 && a + 1 < argc && (spec.bjtCurves = spec_list(argv[a+1], spec.bjt)) > 0){
+            a++;
+            sweepSet = 1;
+        }
+        else if(strcmp(argv[a], "--adaptive") == 0){
+            adaptive = 1;
+        }
+        else if(strcmp(argv[a], "--adapt-tol") == 0 && a + 1 < argc){
+            adaptTol = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--adapt-budget") == 0 && a + 1 < argc){
+            adaptBudget = atoi(argv[++a]);
+            if(adaptBudget < 2 || adaptBudget > MAX_POINTS){
+                printf("--adapt-budget takes 2-%d points per curve.\n", MAX_POINTS);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[a], "--sprt-alpha") == 0 && a + 1 < argc){
+            sprtAlpha = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--sprt-eps") == 0 && a + 1 < argc){
+            sprtEps = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--settle-lsb") == 0 && a + 1 < argc){
+            settleTol = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--settle-timeout") == 0 && a + 1 < argc){
+            settleTimeout = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--debounce") == 0 && a + 1 < argc){
+            buttonDebounce = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--button-timeout") == 0 && a + 1 < argc){
+            buttonTimeout = (int)(atof(argv[++a]) * 1000);
+        }
+        else if(strcmp(argv[a], "--sim-press") == 0 && a + 1 < argc){
+            simPress = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--sockets") == 0 && a + 1 < argc){
+            socketCount = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--sim-clock") == 0){
+            simClock = 1;
+        }
+        else if(strcmp(argv[a], "--export") == 0 && a + 1 < argc){
+            exportDir = argv[++a];
+        }
+        else if(strcmp(argv[a], "--plot") == 0 && a + 1 < argc){
+            a++;
+            plotMode = strcmp(argv[a], "native") == 0 ? PLOT_NATIVE : (strcmp(argv[a], "python") == 0 ? PLOT_PYTHON :
+                       (strcmp(argv[a], "worker") == 0 ? PLOT_WORKER : PLOT_NONE));
+        }
+        else if(strcmp(argv[a], "--plot-script") == 0 && a + 1 < argc){
+            plotScript = argv[++a];
+        }
+        else if(strcmp(argv[a], "--trace") == 0){
+            traceOut = 1;
+        }
+        else if(strcmp(argv[a], "--to-csv") == 0){
+            int failed = 0;
+            while(++a < argc){
+                failed |= (trace_convert(argv[a], NULL) < 0);
+            }
+            return failed ? -1 : 0;
+        }
+        else if(strcmp(argv[a], "--production") == 0 && a + 1 < argc){
+            production = 1;
+            if(runlog_open(argv[++a]) < 0){
+                return -1;
+            }
+        }
+        else if(strcmp(argv[a], "--trigger") == 0 && a + 1 < argc && strcmp(argv[a+1], "gpio") == 0){
+            triggerSource = TRIGGER_GPIO;
+            a++;
+        }
+        else if(strcmp(argv[a], "--trigger") == 0 && a + 2 < argc && strcmp(argv[a+1], "socket") == 0){
+            triggerSource = TRIGGER_SOCKET;
+            triggerPath = argv[a+2];
+            a += 2;
+        }
+        else if(strcmp(argv[a], "--tests") == 0 && a + 1 < argc){
+            tests = atoi(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--transfer") == 0 && a + 1 < argc){
+            transferVolts = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--transfer-points") == 0 && a + 1 < argc){
+            transferPoints = max(0, atoi(argv[++a]));
+        }
+        else if(strcmp(argv[a], "--progressive") == 0){
+            progressive = 1;
+        }
+        else if(strcmp(argv[a], "--live") == 0 && a + 1 < argc){
+            liveFps = atof(argv[++a]);
+        }
+        else if(strcmp(argv[a], "--live-socket") == 0 && a + 1 < argc){
+            liveSocket = argv[++a];
+        }
+        else if(strcmp(argv[a], "--live-frames") == 0 && a + 1 < argc){
+            liveFrames = atoi(argv[++a]);
+            if(liveFrames < 0){
+                printf("--live-frames takes a frame count, 0 to run until the button.\n");
+                return -1;
+            }
+        }
+        else{
+            printf("Usage: %s [--spidev [device]] [--rt [cpu]] [--bench points] [--sim nmos|pmos|npn|pnp|open [--pins XYZ] [--noise LSB] [--seed N] [--tau us] [--sim-press ms] [--sim-clock]] [--sockets N] [--tests N]\n"
+                   "       [--sweep full|quick|lab|file] [--points N] [--span V] [--gates V,V,..] [--bases V,V,..]\n"
+                   "       [--avg-se LSB [--avg-min N] [--avg-max N] [--avg-log file]] [--adaptive [--adapt-tol F] [--adapt-budget N]] [--progressive]\n"
+                   "       [--transfer V [--transfer-points N]]\n"
+                   "       [--sprt-alpha P] [--sprt-eps P] [--settle-lsb LSB] [--settle-timeout ms] [--debounce ms] [--button-timeout s]\n"
+                   "       [--plot native|python|worker|none [--plot-script file]] [--export dir] [--trace] [--production log [--trigger gpio|socket path]]\n"
+                   "       [--live fps [--live-socket path] [--live-frames N]]\n"
+                   "       --to-csv file.trc..\n", argv[0]);
+            return -1;
+        }
+	}
 
-	// establish GPIO and I2C protocols
-	wiringPiSetup();
-	fd = wiringPiI2CSetup(0x20);
+	if(benchPoints > 0){
+        socketCount = 1;    // the benchmark times one board
+	}
+	if(socketCount < 1 || socketCount > MAX_SOCKETS){
+        printf("Between 1 and %d sockets.\n", MAX_SOCKETS);
+        return -1;
+	}
+	if(dev != &simDevice && spiBackend == SPI_BCM2835 && socketCount > 2){
+        printf("The bcm2835 backend has chip selects for 2 sockets, use --spidev for more.\n");
+        return -1;
+	}
+	if(production && !sweepSet){
+        spec_load("quick");
+	}
+	if(plotMode < 0){
+        plotMode = (dev->onPi && !production) ? PLOT_NATIVE : PLOT_NONE;
+	}
+	if(exportDir == NULL && dev->onPi && !production){
+        exportDir = EXPORT_USB_DIR;     // the USB stick
+        exportMount = 1;
+	}
+	if(transferVolts < 0 || transferVolts > VMAX || (transferVolts > 0 && liveFps > 0)){
+        printf("--transfer takes a VDS/VCE of 0-%.2f V and doesn't run live.\n", VMAX);
+        return -1;
+	}
+	if(progressive && adaptive){
+        printf("--progressive and --adaptive each choose their own point order, pick one.\n");
+        return -1;
+	}
+	if(liveFps > 0 && (socketCount > 1 || production)){
+        printf("Live mode runs a single socket outside production.\n");
+        return -1;
+	}
+	if(traceOut && spec.points > TRACE_CODE + 1){
+        printf("A trace holds up to %d points per curve.\n", TRACE_CODE + 1);
+        return -1;
+	}
+	if(rtMode){
+        rt_enter();
+	}
 
-    // establish SPI protocols
-	SPI_init();
-
-	while(1){
+    // establish SPI, GPIO and I2C protocols
+	if(dev->init() < 0){
+        return -1;
+	}
+	if(seg_start() < 0 || export_start() < 0){
+        return -1;
+	}
+	if(socket_start(simPart, simPins) < 0 || live_start() < 0){
+        return -1;
+	}
 
-        printf("Press test button when ready...\n\n");
+	if(benchPoints > 0){
+        AD5592_reset();
+        AD5592_config();
+        SPI_benchmark(benchPoints);
+        return 0;
+	}
+	if(production && trigger_open() < 0){
+        return -1;
+	}
+	if(plot_worker_start() < 0){
+        return -1;
+	}
 
-        bcm2835_gpio_fsel(TEST_PIN, BCM2835_GPIO_FSEL_INPT);
-        bcm2835_gpio_set_pud(TEST_PIN, BCM2835_GPIO_PUD_UP);
+	while(tests == 0 || testCnt < tests){
 
-        while(buttonRead == 1){ // test button
-            buttonRead = bcm2835_gpio_lev(TEST_PIN);
+        if(production){
+            clock_gettime(CLOCK_MONOTONIC, &waitStart);
+            pressed = trigger_wait();
         }
-
-        buttonRead = 1;
-
-        AD5592_reset();
-        AD5592_config();
-        fcount=1;
-
-        // the meat and potatoes
-        calVolts = AD5592_calibration();
-        switch(volt_cycle(mosfet[0], mosfet[1], mosfet[2])){	//This will determine terminal identity, type, and subtype.
-            case 1:
-                terminal_id[0] = GATE;
-                type = MOSFET;
-                subtype = type_finder(1, 0);
-                drain_source(1,2,0,subtype);
-                break;
-            case 2:
-                terminal_id[1] = GATE;
-                type = MOSFET;
-                subtype = type_finder(0, 1);
-                drain_source(0,2,1,subtype);
-                break;
-            case 3:
-                terminal_id[2] = GATE;
-                type = MOSFET;
-                subtype = type_finder(0, 2);
-                drain_source(1,0,2,subtype);
-                break;
-            default:
-                type = BJT;
-                subtype = bjt_typer(/*mosfet[0], mosfet[1], mosfet[2]*/);
-                if(terminal_id[0]==BASE){
-                    bjt_terminal_id(subtype, 0);
-                } else if (terminal_id[1]==BASE){
-                    bjt_terminal_id(subtype, 1);
-                } else if (terminal_id[2]==BASE){
-                    bjt_terminal_id(subtype, 2);
-                }
-                break;
-        } // error check
-        if((type == TBD)||(subtype == TBD)||(terminal_id[0] == TBD)||(terminal_id[1] == TBD)||(terminal_id[2] == TBD)){
-            printf("Identification Error.  Check device and try again.\n");
-            wiringPiI2CWrite(fd, 134); //letter E for ERROR
-            delay(SEGDELAY);
+        else{
+            printf("Press test button when ready...\n\n");
+            pressed = button_wait(buttonTimeout);
+        }
+        if(pressed < 0){
+            return -1;
+        }
+        if(pressed == 0){
+            if(production){
+                printf("Handler stopped.\n");
+            }
+            else{
+                printf("No test button press in %.1f s, stopping.\n", buttonTimeout / 1000.0);
+            }
+            break;
+        }
+        if(buttonRejected > 0){
+            printf("Ignored %d button glitches.\n", buttonRejected);
+        }
+        testCnt++;
+        clock_gettime(CLOCK_MONOTONIC, &testStart);
+        if(production && prod.rounds == 0){
+            prod.start = testStart;
+        }
+        if(socketCount == 1){
+            socket_test();
         }
         else{
-        display_id(terminal_id[0], terminal_id[1], terminal_id[2], type, subtype);
-        if(fd==-1){
-            printf("Can't setup the 7segment display.\n");
-            return -1;
-        } else {
-                Sev_seg_disp(type, subtype, terminal_id[0], terminal_id[1], terminal_id[2], fd);    //Type, Subtype, Terminals 1, 2, 3
+            busSeconds = 0;
+            socket_round();
+            if(!production){
+                socket_display();
+            }
+            clock_gettime(CLOCK_MONOTONIC, &testStop);
+            sec = (testStop.tv_sec - testStart.tv_sec) + (testStop.tv_nsec - testStart.tv_nsec) / 1e9;
+            printf("Sockets: %d parts in %.3f s (%.3f s per part), bus busy %.0f%%\n\n", socketCount, sec, sec / socketCount, 100 * busSeconds / sec);
+        }
+        if(production){
+            production_record((testStart.tv_sec - waitStart.tv_sec) + (testStart.tv_nsec - waitStart.tv_nsec) / 1e9);
+            production_report(0);
         }
-        printf("\nGenerating Curves...\n\n");
-        // system("echo \"raspberry\" | sudo -S umount /dev/sda1");
-        system("echo \"raspberry\" | sudo -S mkdir /media/pi/usbdrive/ 2> /dev/null");
-        system("echo \"raspberry\" | sudo -S mount --source /dev/sda1 --target /media/pi/usbdrive/");
-        sprintf(fname, "%s_%s_%d.csv", str[type], str[subtype], fcount);
-        FILE *csvfile;
-        while (access(fname, F_OK) != -1){
-            fcount++;
-            sprintf(fname, "%s_%s_%d.csv", str[type], str[subtype],fcount);
-        }
-
-        // curve_switch(terminal_id[0], terminal_id[1], terminal_id[2]);
-
-        voltage_ranger();
-        current_ranger(type, subtype,terminal_id[0], terminal_id[1], terminal_id[2]);
-        char python_run[1000];
-        sprintf(python_run, "python /home/pi/TransistorID/curve.py %s", fname);
-        system(python_run);
-        //system("python /home/pi/TransistorID/curve.py");}
     }
+    if(production){
+        production_report(1);
     }
+    plot_worker_finish();
+    export_finish();
 	return 0;
 }
@@ -0,0 +1,644 @@
+// Native curve plot: the figure curve.py draws, rendered to PNG or SVG without an interpreter or libraries.
+//
+// A plotFigure is the family of curves of one sweep with the labels the CSV carries. Both renderers smooth every
+// curve with curve.py's moving average (7 points, fewer on short curves) and drop its first 2%, draw it in the
+// ggplot colour cycle on a grey axes with a white grid, and add the legend of gate/base values in the upper right
+// and the part and pinout as the heading. Axis labels keep the CSV's TeX form ("$V_{DS}$"), drawn with a subscript.
+//
+// The PNG is an 8-bit palette image compressed with fixed-Huffman deflate on runs, which is what a plot mostly
+// is. Text uses a built-in 5x7 font.
+
+#ifndef PLOT_H
+#define PLOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define PLOT_MAX_CURVES 16
+#define PLOT_WIDTH      1280
+#define PLOT_HEIGHT     720
+#define PLOT_FILTER     7           // curve.py's moving average
+
+struct plotCurve{
+    float gate;                     // gate/base voltage, the legend value
+    int count;
+    const double *x, *y;            // VDS/VCE and current
+};
+
+struct plotFigure{
+    char title[64];                 // "Curve Trace"
+    char heading[160];              // type, subtype and terminals
+    char gateLabel[32], xLabel[32], yLabel[32];     // as in the CSV, e.g. "$V_{G}$"
+    double xMin, xMax;              // x axis; the y axis fits the data
+    int curves;
+    plotCurve curve[PLOT_MAX_CURVES];
+};
+
+// A figure handed to the plotting worker (plotd.py) in shared memory: this header, then x[curves][stride] and
+// y[curves][stride] as doubles. seq is written last, once the rest is in place.
+#define PLOT_SHM_MAGIC 0x544F4C50   // "PLOT"
+
+struct plotShared{
+    uint32_t magic;
+    uint32_t seq;                   // figures posted to this slot
+    double done;                    // CLOCK_MONOTONIC seconds when the sweep finished
+    int32_t curves, stride;
+    float gate[PLOT_MAX_CURVES];
+    int32_t count[PLOT_MAX_CURVES];
+    char heading[160];
+    char labels[96];                // gate, x and y labels as in the CSV, comma separated
+};
+
+// layout, pixels
+#define PLOT_LEFT   120
+#define PLOT_RIGHT  (PLOT_WIDTH - 40)
+#define PLOT_TOP    110
+#define PLOT_BOTTOM (PLOT_HEIGHT - 90)
+
+// palette: figure, axes, grid/legend, text, tick text, shadow, then the ggplot colour cycle
+#define PLOT_COLOURS 13
+#define PLOT_CYCLE   7
+static const uint32_t plotPalette[PLOT_COLOURS] = {
+    0xFFFFFF, 0xE5E5E5, 0xFFFFFF, 0x000000, 0x555555, 0xB0B0B0,
+    0xE24A33, 0x348ABD, 0x988ED5, 0x777777, 0xFBC15E, 0x8EBA42, 0xFFB5B8,
+};
+#define PLOT_FIGURE 0
+#define PLOT_AXES   1
+#define PLOT_GRID   2
+#define PLOT_TEXT   3
+#define PLOT_TICKS  4
+#define PLOT_SHADOW 5
+#define PLOT_LINE   6
+
+// 5x7 font, ASCII 32-126, one byte per column, bit 0 at the top
+static const uint8_t plotFont[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},
+    {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x56,0x20,0x50}, {0x00,0x08,0x07,0x03,0x00},
+    {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x2A,0x1C,0x7F,0x1C,0x2A}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x80,0x70,0x30,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x00,0x60,0x60,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x72,0x49,0x49,0x49,0x46}, {0x21,0x41,0x49,0x4D,0x33},
+    {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x31}, {0x41,0x21,0x11,0x09,0x07},
+    {0x36,0x49,0x49,0x49,0x36}, {0x46,0x49,0x49,0x29,0x1E}, {0x00,0x00,0x14,0x00,0x00}, {0x00,0x40,0x34,0x00,0x00},
+    {0x00,0x08,0x14,0x22,0x41}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x59,0x09,0x06},
+    {0x3E,0x41,0x5D,0x59,0x4E}, {0x7C,0x12,0x11,0x12,0x7C}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x41,0x3E}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x41,0x51,0x73},
+    {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},
+    {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x1C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x26,0x49,0x49,0x49,0x32},
+    {0x03,0x01,0x7F,0x01,0x03}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},
+    {0x63,0x14,0x08,0x14,0x63}, {0x03,0x04,0x78,0x04,0x03}, {0x61,0x59,0x49,0x4D,0x43}, {0x00,0x7F,0x41,0x41,0x41},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x41,0x7F}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x03,0x07,0x08,0x00}, {0x20,0x54,0x54,0x78,0x40}, {0x7F,0x28,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x28},
+    {0x38,0x44,0x44,0x28,0x7F}, {0x38,0x54,0x54,0x54,0x18}, {0x00,0x08,0x7E,0x09,0x02}, {0x18,0xA4,0xA4,0x9C,0x78},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x40,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x78,0x04,0x78}, {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0xFC,0x18,0x24,0x24,0x18}, {0x18,0x24,0x24,0x18,0xFC}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x24},
+    {0x04,0x04,0x3F,0x44,0x24}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C},
+    {0x44,0x28,0x10,0x28,0x44}, {0x4C,0x90,0x90,0x90,0x7C}, {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x77,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x02,0x01,0x02,0x04,0x02},
+};
+
+/* ---- figure geometry, shared by both renderers ---- */
+
+// a curve as curve.py plots it: moving average of `filter` points, first count/50 points dropped
+struct plotTrace{
+    int count;
+    double *x, *y;
+};
+
+static inline int plot_smooth(const plotCurve *c, plotTrace *t){
+    int n = c->count, f = n / 50, skip = n / 50;
+    double sx = 0, sy = 0;
+
+    f = f < 1 ? 1 : (f > PLOT_FILTER ? PLOT_FILTER : f);
+    t->count = 0;
+    t->x = (double *)malloc(2 * sizeof(double) * (n + 1));
+    if(t->x == NULL){
+        return -1;
+    }
+    t->y = t->x + n + 1;
+    for(int i = 0; i < n; i++){
+        sx += c->x[i]; sy += c->y[i];
+        if(i >= f){
+            sx -= c->x[i-f]; sy -= c->y[i-f];
+        }
+        if(i >= skip){
+            t->x[t->count] = sx / f;
+            t->y[t->count++] = sy / f;
+        }
+    }
+    return 0;
+}
+
+// nice tick step for a span: 1, 2, 2.5 or 5 times a power of ten, about 6 ticks
+static inline double plot_step(double span){
+    double raw = span / 6, mag = pow(10, floor(log10(raw))), m = raw / mag;
+
+    return mag * (m < 1.5 ? 1 : (m < 2.25 ? 2 : (m < 3.5 ? 2.5 : (m < 7.5 ? 5 : 10))));
+}
+
+// decimals that show a tick step
+static inline int plot_decimals(double step){
+    int d = 0;
+
+    while(d < 9 && fabs(step * pow(10, d) - floor(step * pow(10, d) + 0.5)) > 1e-6){
+        d++;
+    }
+    return d;
+}
+
+struct plotAxes{
+    double xMin, xMax, yMin, yMax;
+    double xStep, yStep;
+    plotTrace trace[PLOT_MAX_CURVES];
+};
+
+// smooth the curves and fit the y axis to them with matplotlib's 5% margins
+static inline int plot_axes(const plotFigure *f, plotAxes *a){
+    double lo = HUGE_VAL, hi = -HUGE_VAL;
+
+    memset(a, 0, sizeof(*a));
+    a->xMin = f->xMin; a->xMax = f->xMax;
+    for(int k = 0; k < f->curves; k++){
+        if(plot_smooth(&f->curve[k], &a->trace[k]) < 0){
+            return -1;
+        }
+        for(int i = 0; i < a->trace[k].count; i++){
+            lo = fmin(lo, a->trace[k].y[i]);
+            hi = fmax(hi, a->trace[k].y[i]);
+        }
+    }
+    if(lo > hi){
+        lo = 0; hi = 1;
+    }
+    if(hi - lo < 1e-12){
+        lo -= 0.5e-3; hi += 0.5e-3;
+    }
+    a->yMin = lo - 0.05 * (hi - lo);
+    a->yMax = hi + 0.05 * (hi - lo);
+    a->xStep = plot_step(a->xMax - a->xMin);
+    a->yStep = plot_step(a->yMax - a->yMin);
+    return 0;
+}
+
+static inline void plot_axes_free(plotAxes *a){
+    for(int k = 0; k < PLOT_MAX_CURVES; k++){
+        free(a->trace[k].x);
+    }
+}
+
+static inline double plot_px(const plotAxes *a, double x){
+    return PLOT_LEFT + (x - a->xMin) / (a->xMax - a->xMin) * (PLOT_RIGHT - PLOT_LEFT);
+}
+
+static inline double plot_py(const plotAxes *a, double y){
+    return PLOT_BOTTOM - (y - a->yMin) / (a->yMax - a->yMin) * (PLOT_BOTTOM - PLOT_TOP);
+}
+
+// split a "$V_{DS}$" or "$I_D$" label into "V" and "DS"; plain text has no subscript
+static inline void plot_tex(const char *label, char *main, char *sub){
+    const char *u = strchr(label, '_');
+    int n;
+
+    main[0] = sub[0] = 0;
+    if(label[0] == '$'){
+        label++;
+    }
+    if(u == NULL){
+        n = strcspn(label, "$");
+        snprintf(main, 32, "%.*s", n, label);
+        return;
+    }
+    snprintf(main, 32, "%.*s", (int)(u - label), label);
+    if(u[1] == '{'){
+        n = strcspn(u + 2, "}");
+        snprintf(sub, 32, "%.*s", n, u + 2);
+    }
+    else{
+        snprintf(sub, 32, "%.1s", u + 1);
+    }
+}
+
+// tick value as text, without a "-0"
+static inline void plot_tick(char *text, double t, double step){
+    snprintf(text, 32, "%.*f", plot_decimals(step), fabs(t) < step * 1e-6 ? 0.0 : t);
+}
+
+// legend entry k counts from the top; curve.py lists the curves last to first
+static inline void plot_legend(const plotFigure *f, int k, char *value){
+    snprintf(value, 32, " = %.1f", f->curve[f->curves - 1 - k].gate);
+}
+
+/* ---- PNG ---- */
+
+struct plotImage{
+    uint8_t *pixel;                 // palette indices, PLOT_WIDTH x PLOT_HEIGHT
+};
+
+static inline void plot_dot(plotImage *im, int x, int y, int colour){
+    if(x >= 0 && x < PLOT_WIDTH && y >= 0 && y < PLOT_HEIGHT){
+        im->pixel[y * PLOT_WIDTH + x] = colour;
+    }
+}
+
+static inline void plot_fill(plotImage *im, int x0, int y0, int x1, int y1, int colour){
+    for(int y = y0; y < y1; y++){
+        for(int x = x0; x < x1; x++){
+            plot_dot(im, x, y, colour);
+        }
+    }
+}
+
+// text at scale s (pixels per font dot), returns the width drawn; vertical runs it bottom to top
+static inline int plot_text(plotImage *im, int x, int y, const char *text, int s, int colour, int vertical){
+    int w = 0;
+
+    for(const char *c = text; *c; c++){
+        int g = (*c < 32 || *c > 126) ? 0 : *c - 32;
+        for(int col = 0; col < 5; col++){
+            for(int row = 0; row < 8; row++){
+                if(im != NULL && (plotFont[g][col] >> row) & 1){
+                    if(vertical){
+                        plot_fill(im, x + row * s, y - (w + col + 1) * s, x + (row + 1) * s, y - (w + col) * s, colour);
+                    }
+                    else{
+                        plot_fill(im, x + (w + col) * s, y + row * s, x + (w + col + 1) * s, y + (row + 1) * s, colour);
+                    }
+                }
+            }
+        }
+        w += 6;
+    }
+    return w * s;
+}
+
+// a TeX label: main text at scale s, subscript a size smaller and lowered
+static inline int plot_label(plotImage *im, int x, int y, const char *label, int s, int colour, int vertical){
+    char main[32], sub[32];
+    int w;
+
+    plot_tex(label, main, sub);
+    w = plot_text(im, x, y, main, s, colour, vertical);
+    if(sub[0]){
+        if(vertical){
+            w += plot_text(im, x + 4 * s, y - w, sub, s - 1, colour, 1);
+        }
+        else{
+            w += plot_text(im, x + w, y + 4 * s, sub, s - 1, colour, 0);
+        }
+    }
+    return w;
+}
+
+// line of width 3 from (x0,y0) to (x1,y1), clipped to the axes
+static inline void plot_line(plotImage *im, double x0, double y0, double x1, double y1, int colour){
+    int steps = (int)fmax(fabs(x1 - x0), fabs(y1 - y0)) + 1;
+
+    for(int i = 0; i <= steps; i++){
+        int x = (int)floor(x0 + (x1 - x0) * i / steps + 0.5), y = (int)floor(y0 + (y1 - y0) * i / steps + 0.5);
+        for(int dy = -1; dy <= 1; dy++){
+            for(int dx = -1; dx <= 1; dx++){
+                if(x + dx >= PLOT_LEFT && x + dx < PLOT_RIGHT && y + dy >= PLOT_TOP && y + dy < PLOT_BOTTOM){
+                    plot_dot(im, x + dx, y + dy, colour);
+                }
+            }
+        }
+    }
+}
+
+// bits of the deflate stream, least significant first
+struct plotBits{
+    uint8_t *buf;
+    size_t len, cap;
+    uint32_t acc;
+    int n;
+};
+
+static inline int plot_byte(plotBits *b, uint8_t v){
+    if(b->len == b->cap){
+        uint8_t *grown = (uint8_t *)realloc(b->buf, b->cap * 2 + 4096);
+        if(grown == NULL){
+            return -1;
+        }
+        b->buf = grown;
+        b->cap = b->cap * 2 + 4096;
+    }
+    b->buf[b->len++] = v;
+    return 0;
+}
+
+static inline void plot_bits(plotBits *b, uint32_t bits, int count){
+    b->acc |= bits << b->n;
+    b->n += count;
+    while(b->n >= 8){
+        plot_byte(b, b->acc & 0xFF);
+        b->acc >>= 8;
+        b->n -= 8;
+    }
+}
+
+// a Huffman code goes most significant bit first
+static inline void plot_huffman(plotBits *b, uint32_t code, int len){
+    uint32_t r = 0;
+
+    for(int i = 0; i < len; i++){
+        r = (r << 1) | ((code >> i) & 1);
+    }
+    plot_bits(b, r, len);
+}
+
+// fixed Huffman literal/length symbol
+static inline void plot_symbol(plotBits *b, int sym){
+    if(sym < 144)      plot_huffman(b, 0x30 + sym, 8);
+    else if(sym < 256) plot_huffman(b, 0x190 + sym - 144, 9);
+    else if(sym < 280) plot_huffman(b, sym - 256, 7);
+    else               plot_huffman(b, 0xC0 + sym - 280, 8);
+}
+
+// repeat the previous byte len times (3-258): a match at distance 1
+static inline void plot_run(plotBits *b, int len){
+    static const int base[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+    static const int extra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+    int c = 28;
+
+    while(base[c] > len){
+        c--;
+    }
+    plot_symbol(b, 257 + c);
+    if(extra[c]){
+        plot_bits(b, len - base[c], extra[c]);
+    }
+    plot_huffman(b, 0, 5);          // distance code 0: one byte back
+}
+
+static inline uint32_t plot_crc(uint32_t crc, const uint8_t *p, size_t n){
+    static uint32_t table[256];
+
+    if(table[1] == 0){
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++){
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while(n--){
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static inline void plot_be32(uint8_t *p, uint32_t v){
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline void plot_chunk(FILE *out, const char *type, const uint8_t *data, uint32_t n){
+    uint8_t word[4];
+    uint32_t crc = plot_crc(0, (const uint8_t *)type, 4);
+
+    crc = plot_crc(crc, data, n);
+    plot_be32(word, n);
+    fwrite(word, 4, 1, out);
+    fwrite(type, 4, 1, out);
+    fwrite(data, 1, n, out);
+    plot_be32(word, crc);
+    fwrite(word, 4, 1, out);
+}
+
+// zlib stream of the image rows (filter byte 0 before each row) and the PNG around it
+static inline int plot_png_write(const plotImage *im, const char *path){
+    plotBits b = {NULL, 0, 0, 0, 0};
+    uint8_t head[13], palette[3 * PLOT_COLOURS];
+    uint32_t s1 = 1, s2 = 0;
+    size_t total = (size_t)PLOT_HEIGHT * (PLOT_WIDTH + 1);
+    int prev = -1, i = 0;
+    FILE *out;
+
+    plot_byte(&b, 0x78);
+    plot_byte(&b, 0x01);
+    plot_bits(&b, 1, 1);            // final block
+    plot_bits(&b, 1, 2);            // fixed Huffman codes
+    while((size_t)i < total){
+        int row = i / (PLOT_WIDTH + 1), col = i % (PLOT_WIDTH + 1);
+        int v = col == 0 ? 0 : im->pixel[row * PLOT_WIDTH + col - 1];
+        int run = 0;
+
+        // length of the run of v starting here, when it repeats the byte before
+        if(v == prev){
+            for(size_t j = i; j < total && run < 258; j++, run++){
+                int r = j / (PLOT_WIDTH + 1), cc = j % (PLOT_WIDTH + 1);
+                if((cc == 0 ? 0 : im->pixel[r * PLOT_WIDTH + cc - 1]) != v){
+                    break;
+                }
+            }
+        }
+        if(run >= 3){
+            plot_run(&b, run);
+        }
+        else{
+            plot_symbol(&b, v);
+            run = 1;
+        }
+        for(int k = 0; k < run; k++){
+            s1 = (s1 + v) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+        i += run;
+        prev = v;
+    }
+    plot_symbol(&b, 256);           // end of block
+    if(b.n > 0){
+        plot_bits(&b, 0, 8 - b.n);
+    }
+    plot_byte(&b, s2 >> 8); plot_byte(&b, s2); plot_byte(&b, s1 >> 8); plot_byte(&b, s1);
+    if(b.buf == NULL || b.len < 4){
+        free(b.buf);
+        return -1;
+    }
+
+    out = fopen(path, "wb");
+    if(out == NULL){
+        free(b.buf);
+        return -1;
+    }
+    fwrite("\x89PNG\r\n\x1a\n", 8, 1, out);
+    plot_be32(head, PLOT_WIDTH);
+    plot_be32(head + 4, PLOT_HEIGHT);
+    head[8] = 8; head[9] = 3; head[10] = 0; head[11] = 0; head[12] = 0;     // 8-bit palette
+    plot_chunk(out, "IHDR", head, 13);
+    for(int c = 0; c < PLOT_COLOURS; c++){
+        palette[3*c] = plotPalette[c] >> 16; palette[3*c+1] = plotPalette[c] >> 8; palette[3*c+2] = plotPalette[c];
+    }
+    plot_chunk(out, "PLTE", palette, sizeof(palette));
+    plot_chunk(out, "IDAT", b.buf, b.len);
+    plot_chunk(out, "IEND", NULL, 0);
+    free(b.buf);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// render the figure to a PNG file, 0 on success
+static inline int plot_png(const plotFigure *f, const char *path){
+    plotImage im;
+    plotAxes a;
+    char text[64], value[32];
+    int w, x, y, legendW = 0, ok;
+
+    memset(&a, 0, sizeof(a));
+    im.pixel = (uint8_t *)malloc(PLOT_WIDTH * PLOT_HEIGHT);
+    if(im.pixel == NULL || plot_axes(f, &a) < 0){
+        free(im.pixel);
+        plot_axes_free(&a);
+        return -1;
+    }
+    memset(im.pixel, PLOT_FIGURE, PLOT_WIDTH * PLOT_HEIGHT);
+
+    // headings
+    w = plot_text(NULL, 0, 0, f->heading, 2, 0, 0);
+    plot_text(&im, (PLOT_WIDTH - w) / 2, 24, f->heading, 2, PLOT_TEXT, 0);
+    w = plot_text(NULL, 0, 0, f->title, 2, 0, 0);
+    plot_text(&im, (PLOT_WIDTH - w) / 2, 72, f->title, 2, PLOT_TEXT, 0);
+
+    // axes, grid and ticks
+    plot_fill(&im, PLOT_LEFT, PLOT_TOP, PLOT_RIGHT, PLOT_BOTTOM, PLOT_AXES);
+    for(double t = ceil(a.xMin / a.xStep - 1e-9) * a.xStep; t <= a.xMax + 1e-9; t += a.xStep){
+        x = (int)floor(plot_px(&a, t) + 0.5);
+        plot_fill(&im, x, PLOT_TOP, x + 1, PLOT_BOTTOM, PLOT_GRID);
+        plot_tick(text, t, a.xStep);
+        w = plot_text(NULL, 0, 0, text, 2, 0, 0);
+        plot_text(&im, x - w / 2, PLOT_BOTTOM + 10, text, 2, PLOT_TICKS, 0);
+    }
+    for(double t = ceil(a.yMin / a.yStep - 1e-9) * a.yStep; t <= a.yMax + 1e-12; t += a.yStep){
+        y = (int)floor(plot_py(&a, t) + 0.5);
+        plot_fill(&im, PLOT_LEFT, y, PLOT_RIGHT, y + 1, PLOT_GRID);
+        plot_tick(text, t, a.yStep);
+        w = plot_text(NULL, 0, 0, text, 2, 0, 0);
+        plot_text(&im, PLOT_LEFT - 8 - w, y - 7, text, 2, PLOT_TICKS, 0);
+    }
+    w = plot_label(NULL, 0, 0, f->xLabel, 3, 0, 0);
+    plot_label(&im, (PLOT_LEFT + PLOT_RIGHT - w) / 2, PLOT_BOTTOM + 40, f->xLabel, 3, PLOT_TEXT, 0);
+    w = plot_label(NULL, 0, 0, f->yLabel, 3, 0, 0);
+    plot_label(&im, 12, (PLOT_TOP + PLOT_BOTTOM + w) / 2, f->yLabel, 3, PLOT_TEXT, 1);
+
+    // curves
+    for(int k = 0; k < f->curves; k++){
+        plotTrace *t = &a.trace[k];
+        for(int i = 1; i < t->count; i++){
+            plot_line(&im, plot_px(&a, t->x[i-1]), plot_py(&a, t->y[i-1]), plot_px(&a, t->x[i]), plot_py(&a, t->y[i]), PLOT_LINE + k % PLOT_CYCLE);
+        }
+    }
+
+    // legend, upper right with a shadow
+    for(int k = 0; k < f->curves; k++){
+        plot_legend(f, k, value);
+        w = plot_label(NULL, 0, 0, f->gateLabel, 2, 0, 0) + plot_text(NULL, 0, 0, value, 2, 0, 0);
+        legendW = w > legendW ? w : legendW;
+    }
+    if(f->curves > 0){
+        int x0 = PLOT_RIGHT - legendW - 70, y0 = PLOT_TOP + 10, h = 24 * f->curves + 12;
+        plot_fill(&im, x0 + 4, y0 + 4, PLOT_RIGHT - 6, y0 + h + 4, PLOT_SHADOW);
+        plot_fill(&im, x0, y0, PLOT_RIGHT - 10, y0 + h, PLOT_GRID);
+        for(int k = 0; k < f->curves; k++){
+            int c = f->curves - 1 - k;
+            y = y0 + 10 + 24 * k;
+            plot_fill(&im, x0 + 10, y + 6, x0 + 40, y + 9, PLOT_LINE + c % PLOT_CYCLE);
+            plot_legend(f, k, value);
+            w = plot_label(&im, x0 + 50, y, f->gateLabel, 2, PLOT_TEXT, 0);
+            plot_text(&im, x0 + 50 + w, y, value, 2, PLOT_TEXT, 0);
+        }
+    }
+
+    ok = plot_png_write(&im, path);
+    free(im.pixel);
+    plot_axes_free(&a);
+    return ok;
+}
+
+/* ---- SVG ---- */
+
+static inline void plot_svg_label(FILE *out, const char *label){
+    char main[32], sub[32];
+
+    plot_tex(label, main, sub);
+    fprintf(out, "%s", main);
+    if(sub[0]){
+        fprintf(out, "<tspan baseline-shift=\"sub\" font-size=\"70%%\">%s</tspan>", sub);
+    }
+}
+
+// render the figure to an SVG file, 0 on success
+static inline int plot_svg(const plotFigure *f, const char *path){
+    plotAxes a;
+    char text[32], value[32];
+    FILE *out;
+
+    if(plot_axes(f, &a) < 0){
+        plot_axes_free(&a);
+        return -1;
+    }
+    out = fopen(path, "w");
+    if(out == NULL){
+        plot_axes_free(&a);
+        return -1;
+    }
+    fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" font-family=\"DejaVu Sans, sans-serif\">\n", PLOT_WIDTH, PLOT_HEIGHT);
+    fprintf(out, "<defs><clipPath id=\"axes\"><rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\"/></clipPath></defs>\n",
+            PLOT_LEFT, PLOT_TOP, PLOT_RIGHT - PLOT_LEFT, PLOT_BOTTOM - PLOT_TOP);
+    fprintf(out, "<rect width=\"100%%\" height=\"100%%\" fill=\"#%06X\"/>\n", plotPalette[PLOT_FIGURE]);
+    fprintf(out, "<text x=\"%d\" y=\"38\" font-size=\"18\" text-anchor=\"middle\">%s</text>\n", PLOT_WIDTH / 2, f->heading);
+    fprintf(out, "<text x=\"%d\" y=\"86\" font-size=\"18\" text-anchor=\"middle\">%s</text>\n", PLOT_WIDTH / 2, f->title);
+    fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%06X\"/>\n",
+            PLOT_LEFT, PLOT_TOP, PLOT_RIGHT - PLOT_LEFT, PLOT_BOTTOM - PLOT_TOP, plotPalette[PLOT_AXES]);
+
+    for(double t = ceil(a.xMin / a.xStep - 1e-9) * a.xStep; t <= a.xMax + 1e-9; t += a.xStep){
+        double x = plot_px(&a, t);
+        fprintf(out, "<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\" stroke=\"#%06X\"/>\n", x, PLOT_TOP, x, PLOT_BOTTOM, plotPalette[PLOT_GRID]);
+        plot_tick(text, t, a.xStep);
+        fprintf(out, "<text x=\"%.1f\" y=\"%d\" font-size=\"16\" fill=\"#%06X\" text-anchor=\"middle\">%s</text>\n",
+                x, PLOT_BOTTOM + 24, plotPalette[PLOT_TICKS], text);
+    }
+    for(double t = ceil(a.yMin / a.yStep - 1e-9) * a.yStep; t <= a.yMax + 1e-12; t += a.yStep){
+        double y = plot_py(&a, t);
+        fprintf(out, "<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\" stroke=\"#%06X\"/>\n", PLOT_LEFT, y, PLOT_RIGHT, y, plotPalette[PLOT_GRID]);
+        plot_tick(text, t, a.yStep);
+        fprintf(out, "<text x=\"%d\" y=\"%.1f\" font-size=\"16\" fill=\"#%06X\" text-anchor=\"end\">%s</text>\n",
+                PLOT_LEFT - 8, y + 5, plotPalette[PLOT_TICKS], text);
+    }
+    fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"22\" text-anchor=\"middle\">", (PLOT_LEFT + PLOT_RIGHT) / 2, PLOT_BOTTOM + 64);
+    plot_svg_label(out, f->xLabel);
+    fprintf(out, "</text>\n<text transform=\"translate(34,%d) rotate(-90)\" font-size=\"22\" text-anchor=\"middle\">", (PLOT_TOP + PLOT_BOTTOM) / 2);
+    plot_svg_label(out, f->yLabel);
+    fprintf(out, "</text>\n<g clip-path=\"url(#axes)\" fill=\"none\" stroke-width=\"3\" stroke-linejoin=\"round\">\n");
+    for(int k = 0; k < f->curves; k++){
+        fprintf(out, "<polyline stroke=\"#%06X\" points=\"", plotPalette[PLOT_LINE + k % PLOT_CYCLE]);
+        for(int i = 0; i < a.trace[k].count; i++){
+            fprintf(out, "%.1f,%.1f ", plot_px(&a, a.trace[k].x[i]), plot_py(&a, a.trace[k].y[i]));
+        }
+        fprintf(out, "\"/>\n");
+    }
+    fprintf(out, "</g>\n");
+
+    if(f->curves > 0){
+        int x0 = PLOT_RIGHT - 190, y0 = PLOT_TOP + 10, h = 26 * f->curves + 12;
+        fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"180\" height=\"%d\" fill=\"#%06X\"/>\n", x0 + 4, y0 + 4, h, plotPalette[PLOT_SHADOW]);
+        fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"180\" height=\"%d\" fill=\"#%06X\"/>\n", x0, y0, h, plotPalette[PLOT_GRID]);
+        for(int k = 0; k < f->curves; k++){
+            int c = f->curves - 1 - k, y = y0 + 22 + 26 * k;
+            fprintf(out, "<line x1=\"%d\" y1=\"%d\" x2=\"%d\" y2=\"%d\" stroke=\"#%06X\" stroke-width=\"3\"/>\n",
+                    x0 + 10, y - 6, x0 + 40, y - 6, plotPalette[PLOT_LINE + c % PLOT_CYCLE]);
+            plot_legend(f, k, value);
+            fprintf(out, "<text x=\"%d\" y=\"%d\" font-size=\"16\">", x0 + 50, y);
+            plot_svg_label(out, f->gateLabel);
+            fprintf(out, "%s</text>\n", value);
+        }
+    }
+    fprintf(out, "</svg>\n");
+    plot_axes_free(&a);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,84 @@
+# Long-lived plotting worker for tracer --plot worker: one window per socket, redrawn in place each time a sweep
+# finishes. tracer maps the figures into shared memory (argv[1]) and writes "slot offset seq" lines on stdin; each
+# is answered with "drawn slot seq ms" on stdout, ms being the time from the end of the sweep to the figure on
+# screen. The worker ends when tracer closes stdin.
+from matplotlib import pyplot as plt
+from matplotlib import style
+import numpy as np
+import mmap
+import struct
+import sys
+import time
+
+filt = 7
+MAGIC = 0x544F4C50
+HEADER = struct.Struct('<IIdii16f16i160s96s')   # struct plotShared in plot.h
+
+style.use('ggplot')
+
+plt.rcParams.update({'font.size': 14})
+plt.ion()
+
+shm = open(sys.argv[1], 'r+b')
+view = mmap.mmap(shm.fileno(), 0)
+
+figures = {}
+
+def window(slot):
+    if slot not in figures:
+        fig = plt.figure(slot + 1)
+        axes = fig.gca()
+        axes.set_xlim([0,4.85])
+        axes.grid(True)
+        figures[slot] = (fig, axes, [])
+    return figures[slot]
+
+def redraw(slot, offset, seq):
+    h = HEADER.unpack_from(view, offset)
+    magic, posted, done, curves, stride = h[0:5]
+    gate, count, heading, labels = h[5:21], h[21:37], h[37], h[38]
+    if magic != MAGIC or posted != seq:
+        return None
+    heading = heading.split(b'\0')[0].decode()
+    label = labels.split(b'\0')[0].decode().split(',')
+    x = np.frombuffer(view, np.float64, curves * stride, offset + HEADER.size).reshape(curves, stride)
+    y = np.frombuffer(view, np.float64, curves * stride, offset + HEADER.size + 16 * stride * 8).reshape(curves, stride)
+
+    fig, axes, lines = window(slot)
+    plots = []
+    labels = []
+    for c in range(curves):
+        n = count[c]
+        f = max(1, min(filt, n // 50))     # the same filter as curve.py
+        vd = np.convolve(x[c, :n], np.ones((f,))/f)
+        idd = np.convolve(y[c, :n], np.ones((f,))/f)
+        if c < len(lines):
+            lines[c].set_data(vd[n // 50:n], idd[n // 50:n])
+            lines[c].set_visible(True)
+        else:
+            lines.append(axes.plot(vd[n // 50:n], idd[n // 50:n], linewidth=3.0)[0])
+        plots.insert(0, lines[c])
+        labels.insert(0, "%s = %.1f" % (label[0], gate[c]))
+    for p in lines[curves:]:
+        p.set_visible(False)
+
+    axes.set_title('Curve Trace')
+    fig.suptitle(heading)
+    axes.set_ylabel(label[2])
+    axes.set_xlabel(label[1])
+    axes.legend(plots, labels, loc='upper right', shadow=True)
+    axes.relim(visible_only=True)
+    axes.autoscale_view(scalex=False)
+    fig.canvas.draw()
+    fig.canvas.flush_events()
+    return (time.clock_gettime(time.CLOCK_MONOTONIC) - done) * 1000
+
+for line in sys.stdin:
+    try:
+        slot, offset, seq = [int(v) for v in line.split()]
+    except ValueError:
+        continue
+    ms = redraw(slot, offset, seq)
+    if ms is not None:
+        sys.stdout.write("drawn %d %d %.1f\n" % (slot, seq, ms))
+        sys.stdout.flush()
@@ -0,0 +1,309 @@
+// Binary curve trace (.trc) written by main.cpp --trace, and a reader that maps one in place.
+//
+// A trace holds what print_csv writes as text: a fixed header (part, terminals, sweep spec, calibration and the
+// conversion constants), then one block per curve. A block is the curve's gate/base value and point count
+// followed by its columns. Everything is little-endian and 8-byte aligned, so the reader hands out pointers
+// straight into the mapping without parsing or copying.
+//
+// The columns are either VDS/VCE and current as doubles (TRACE_DOUBLES) or the codes the sweep measured them
+// from (TRACE_CODES): grid point, mean source/emitter and drain/collector ADC codes and the drain/collector DAC
+// code, 12 bits each packed two to three bytes, plus the ADC samples per channel as 16 bits. Codes take 8 bytes
+// a point against 16, and trace_values turns them into volts and amps with the header's constants, which a
+// reader may change to reprocess a run with a new calibration.
+//
+//     traceFile t;
+//     traceView c;
+//     if(trace_open("MOSFET_NMOS_1.trc", &t) == 0){
+//         for(int k = 0; trace_curve(&t, k, &c) == 0; k++){
+//             trace_values(&t, &c, vds, current);     // or c.vds/c.current in place for TRACE_DOUBLES
+//             ... c.gate, c.count, vds[i], current[i] ...
+//         }
+//         trace_close(&t);
+//     }
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC   0x31435254   // "TRC1"
+#define TRACE_VERSION 1
+#define TRACE_STEPS   16           // gate/base steps the header has room for
+#define TRACE_CODE    4095         // largest 12-bit code, and grid point of a TRACE_CODES trace
+
+#define TRACE_DOUBLES 0            // encoding: VDS/VCE and current columns as doubles
+#define TRACE_CODES   1            // encoding: packed 12-bit code columns, converted when read
+
+struct traceHeader{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;            // sizeof(traceHeader), blocks start here
+    int32_t type, subtype;          // part codes as in main.cpp: MOSFET/BJT, NMOS/PMOS/NPN/PNP
+    int32_t terminal[3];            // GATE, SOURCE, DRAIN, BASE, COLLECTOR or EMITTER
+    int32_t points;                 // sweep grid points per curve
+    float span;                     // VDS/VCE span, V
+    int32_t steps;                  // gate/base steps of the sweep spec
+    float step[TRACE_STEPS];        // their voltages as applied
+    int32_t calVolts;               // identification threshold, ADC codes
+    int32_t adcMax;                 // full-scale ADC/DAC code
+    float vMax;                     // full-scale voltage, V
+    float resistor;                 // terminal resistor, ohm
+    int32_t curves;                 // blocks that follow
+    int16_t encoding;               // TRACE_DOUBLES or TRACE_CODES
+    int16_t trim;                   // PMOS/PNP grid points below this take the current of the first one past it
+};
+
+struct traceCurve{
+    float gate;                     // gate/base voltage of the curve
+    uint32_t count;                 // points, then the columns
+};
+
+struct traceFile{
+    const traceHeader *header;
+    const unsigned char *map;
+    size_t size;
+};
+
+struct traceView{
+    float gate;
+    uint32_t count;
+    const double *vds;              // TRACE_DOUBLES: VDS/VCE, V
+    const double *current;          // TRACE_DOUBLES: ID/IC, A
+    const uint8_t *point, *src, *drn, *dac;    // TRACE_CODES, packed: grid point, source/emitter and drain/collector ADC, drain/collector DAC
+    const uint16_t *samples;        // TRACE_CODES: ADC samples averaged per channel
+};
+
+// part names by code, the strings print_csv writes
+static const char *traceNames[] = {"TBD","GATE","SOURCE","DRAIN","NMOS","PMOS","MOSFET","BJT","NPN","PNP","BASE","COLLECTOR","EMITTER"};
+
+static inline const char *trace_name(int code){
+    return (code >= 0 && code < (int)(sizeof(traceNames) / sizeof(traceNames[0]))) ? traceNames[code] : "TBD";
+}
+
+// bytes of a packed 12-bit column
+static inline size_t trace_packed(uint32_t count){
+    return (3 * (size_t)count + 1) / 2;
+}
+
+// bytes of a curve block holding count points, the samples column on a 2 byte boundary and the next block on 8
+static inline size_t trace_block(int encoding, uint32_t count){
+    if(encoding == TRACE_DOUBLES){
+        return sizeof(traceCurve) + 2 * sizeof(double) * (size_t)count;
+    }
+    return (sizeof(traceCurve) + ((4 * trace_packed(count) + 1) & ~(size_t)1) + sizeof(uint16_t) * count + 7) & ~(size_t)7;
+}
+
+// pack 12-bit codes two to three bytes
+static inline void trace_pack(uint8_t *out, const uint16_t *code, uint32_t count){
+    uint32_t k;
+
+    for(k = 0; k + 1 < count; k += 2, out += 3){
+        out[0] = code[k];
+        out[1] = ((code[k] >> 8) & 0x0F) | (code[k+1] << 4);
+        out[2] = code[k+1] >> 4;
+    }
+    if(k < count){
+        out[0] = code[k];
+        out[1] = (code[k] >> 8) & 0x0F;
+    }
+}
+
+static inline void trace_unpack(const uint8_t *in, uint32_t count, uint16_t *code){
+    uint32_t k;
+
+    for(k = 0; k + 1 < count; k += 2, in += 3){
+        code[k] = in[0] | ((in[1] & 0x0F) << 8);
+        code[k+1] = (in[1] >> 4) | (in[2] << 4);
+    }
+    if(k < count){
+        code[k] = in[0] | ((in[1] & 0x0F) << 8);
+    }
+}
+
+// volts and amps of unpacked codes, one pass over the columns. The arithmetic is the sweep's own, operation
+// for operation, so a trace converts to the same CSV the sweep would have written.
+static inline void trace_codes_values(const traceHeader *h, uint32_t count, const uint16_t *point, const uint16_t *src,
+                                      const uint16_t *drn, const uint16_t *dac, double *vds, double *current){
+    int flip = (h->subtype == 5 || h->subtype == 9);   // PMOS and PNP run the other way
+    uint32_t first;
+
+    for(uint32_t i = 0; i < count; i++){
+        int v = flip ? src[i] - drn[i] : drn[i] - src[i];
+        double c = (double)(dac[i] - drn[i]) / (float)h->adcMax * h->vMax / h->resistor;
+        vds[i] = ((double)v / h->adcMax) * h->vMax;
+        current[i] = flip ? -c : c;
+    }
+
+    // the first grid points of a P curve are ADC noise, they take the current of the first point past them
+    if(flip){
+        for(first = 0; first < count && point[first] < h->trim; first++);
+        for(uint32_t i = 0; i < first && first < count; i++){
+            current[i] = current[first];
+        }
+    }
+}
+
+// map a trace, 0 on success, -1 if it can't be read or isn't a trace
+static inline int trace_open(const char *path, traceFile *t){
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *map;
+
+    memset(t, 0, sizeof(*t));
+    if(fd < 0){
+        return -1;
+    }
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(traceHeader)){
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        return -1;
+    }
+    t->map = (const unsigned char *)map;
+    t->size = st.st_size;
+    t->header = (const traceHeader *)map;
+    if(t->header->magic != TRACE_MAGIC || t->header->version != TRACE_VERSION || t->header->headerSize != sizeof(traceHeader)){
+        munmap(map, st.st_size);
+        memset(t, 0, sizeof(*t));
+        return -1;
+    }
+    return 0;
+}
+
+static inline void trace_close(traceFile *t){
+    if(t->map != NULL){
+        munmap((void *)t->map, t->size);
+    }
+    memset(t, 0, sizeof(*t));
+}
+
+// curve k of the trace, 0 on success, -1 past the last curve or if the file is cut short
+static inline int trace_curve(const traceFile *t, int k, traceView *c){
+    size_t at = t->header->headerSize;
+    const traceCurve *block;
+
+    if(k < 0 || k >= t->header->curves){
+        return -1;
+    }
+    for(int n = 0; ; n++){
+        if(at + sizeof(traceCurve) > t->size){
+            return -1;
+        }
+        block = (const traceCurve *)(t->map + at);
+        if(at + trace_block(t->header->encoding, block->count) > t->size){
+            return -1;
+        }
+        if(n == k){
+            break;
+        }
+        at += trace_block(t->header->encoding, block->count);
+    }
+    memset(c, 0, sizeof(*c));
+    c->gate = block->gate;
+    c->count = block->count;
+    if(t->header->encoding == TRACE_DOUBLES){
+        c->vds = (const double *)(block + 1);
+        c->current = c->vds + block->count;
+    }
+    else{
+        c->point = (const uint8_t *)(block + 1);
+        c->src = c->point + trace_packed(block->count);
+        c->drn = c->src + trace_packed(block->count);
+        c->dac = c->drn + trace_packed(block->count);
+        c->samples = (const uint16_t *)(c->point + ((4 * trace_packed(block->count) + 1) & ~(size_t)1));
+    }
+    return 0;
+}
+
+// a curve's volts and amps into vds and current (count each), converting the codes of a TRACE_CODES trace.
+// -1 if there's no memory to unpack them.
+static inline int trace_values(const traceFile *t, const traceView *c, double *vds, double *current){
+    uint16_t *code;
+
+    if(t->header->encoding == TRACE_DOUBLES){
+        memcpy(vds, c->vds, sizeof(double) * c->count);
+        memcpy(current, c->current, sizeof(double) * c->count);
+        return 0;
+    }
+    code = (uint16_t *)malloc(4 * sizeof(uint16_t) * (c->count + 1));
+    if(code == NULL){
+        return -1;
+    }
+    trace_unpack(c->point, c->count, code);
+    trace_unpack(c->src, c->count, code + c->count);
+    trace_unpack(c->drn, c->count, code + 2 * c->count);
+    trace_unpack(c->dac, c->count, code + 3 * c->count);
+    trace_codes_values(t->header, c->count, code, code + c->count, code + 2 * c->count, code + 3 * c->count, vds, current);
+    free(code);
+    return 0;
+}
+
+// gate/base, x and y axis labels of a subtype's curves, comma separated; NULL for anything else
+static inline const char *trace_axes(int subtype){
+    switch(subtype){
+        case 8:  return "$V_{B}$,$V_{CE}$,$I_C$";     // NPN
+        case 4:  return "$V_{G}$,$V_{DS}$,$I_D$";     // NMOS
+        case 9:  return "$V_{B}$,$V_{EC}$,$I_C$";     // PNP
+        case 5:  return "$V_{G}$,$V_{SD}$,$I_D$";     // PMOS
+        default: return NULL;
+    }
+}
+
+// the three header lines of the curve CSV, as curve.py and the MATLAB scripts read them
+static inline void trace_csv_header(FILE *out, int type, int subtype, const int32_t *terminal){
+    const char *axes = trace_axes(subtype);
+
+    if(axes == NULL){
+        return;
+    }
+    fprintf(out, "Type: %s,Subtype: %s,\n", trace_name(type), trace_name(subtype));
+    fprintf(out, "Terminal 1: %s,Terminal 2: %s,Terminal 3: %s\n", trace_name(terminal[0]), trace_name(terminal[1]), trace_name(terminal[2]));
+    fprintf(out, "%s\n", axes);
+}
+
+// one curve's CSV lines
+static inline void trace_csv_points(FILE *out, float gate, const double *vds, const double *current, uint32_t count){
+    for(uint32_t i = 0; i < count; i++){
+        fprintf(out, "%f,%f,%f\n", gate, vds[i], current[i]);
+    }
+}
+
+// the whole trace in the CSV layout print_csv writes, -1 if it's cut short
+static inline int trace_csv(const traceFile *t, FILE *out){
+    traceView c;
+    double *values;
+    int ok;
+
+    trace_csv_header(out, t->header->type, t->header->subtype, t->header->terminal);
+    for(int k = 0; k < t->header->curves; k++){
+        if(trace_curve(t, k, &c) < 0){
+            return -1;
+        }
+        if(t->header->encoding == TRACE_DOUBLES){
+            trace_csv_points(out, c.gate, c.vds, c.current, c.count);
+            continue;
+        }
+        values = (double *)malloc(2 * sizeof(double) * (c.count + 1));
+        ok = (values != NULL && trace_values(t, &c, values, values + c.count) == 0);
+        if(ok){
+            trace_csv_points(out, c.gate, values, values + c.count, c.count);
+        }
+        free(values);
+        if(!ok){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif